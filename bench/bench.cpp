@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "wreath/dbc/package.hpp"
+#include "wreath/dbc/database.hpp"
+#include "wreath/dbc/trigger.hpp"
+#include "wreath/dbc/filter.hpp"
+#include "wreath/can/can.hpp"
+
+#ifndef WREATHDBC_SOURCE_DIR
+#define WREATHDBC_SOURCE_DIR "."
+#endif
+#ifndef WREATHDBC_BUILD_TYPE
+#define WREATHDBC_BUILD_TYPE "unknown"
+#endif
+#ifndef WREATHDBC_COMPILER
+#define WREATHDBC_COMPILER "unknown"
+#endif
+#ifdef __OPTIMIZE__
+static constexpr bool optimized = true;
+#else
+static constexpr bool optimized = false;
+#endif
+
+//---------------------------------------------------------------------------------------------------------
+
+template<typename T>
+static void do_not_optimize(const T& val){
+    asm volatile("" : : "r,m"(val) : "memory");
+}
+
+static std::string json_escape(const std::string& text){
+    std::string out;
+    for (char c : text){
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20){
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            out += code;
+        } else out += c;
+    }
+    return out;
+}
+
+struct Bench_Result{
+    std::string name;
+    std::size_t iterations;
+    double ns_min;
+    double ns_median;
+    double ns_max;
+};
+
+struct Bench_Suite{
+    std::vector<Bench_Result> results;
+    std::vector<std::pair<std::string, std::string>> skipped;
+    double min_time = 0.2;
+    std::size_t repetitions = 5;
+
+    //'body' runs 'count' operations and returns how many it actually performed
+    template<typename Body>
+    void run(const std::string& name, Body body){
+        std::size_t iterations = 1;
+        while (true){
+            std::chrono::steady_clock::time_point beg = std::chrono::steady_clock::now();
+            body(iterations);
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+            if (elapsed >= min_time / repetitions || iterations >= (std::size_t{1} << 30)) break;
+            iterations = elapsed <= 0.0 ? iterations * 10 : std::max(iterations + 1, (std::size_t)(iterations * (min_time / repetitions) / elapsed * 1.2));
+        }
+
+        std::vector<double> samples;
+        for (std::size_t a = 0; a < repetitions; a++){
+            std::chrono::steady_clock::time_point beg = std::chrono::steady_clock::now();
+            body(iterations);
+            samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - beg).count() / iterations);
+        }
+        std::sort(samples.begin(), samples.end());
+        results.push_back({name, iterations, samples.front(), samples[samples.size() / 2], samples.back()});
+        std::cerr << name << ": " << samples[samples.size() / 2] << " ns/op\n";
+    }
+    //Replaces the result of a run that could not complete with a skip entry
+    void fail(const std::string& name, const std::string& reason){
+        if (!results.empty() && results.back().name == name) results.pop_back();
+        skip(name, reason);
+    }
+    void skip(const std::string& name, const std::string& reason){
+        skipped.push_back({name, reason});
+        std::cerr << name << ": skipped (" << reason << ")\n";
+    }
+
+    void write_json(std::ostream& out) const{
+        out << "{\n  \"build\": {\"type\": \"" << json_escape(WREATHDBC_BUILD_TYPE) << "\", \"compiler\": \"" << json_escape(WREATHDBC_COMPILER) << "\", \"optimized\": " << (optimized ? "true" : "false") << "},\n";
+        out << "  \"benchmarks\": [\n";
+        for (std::size_t a = 0; a < results.size(); a++){
+            const Bench_Result& res = results[a];
+            out << "    {\"name\": \"" << json_escape(res.name) << "\", \"iterations\": " << res.iterations;
+            out << ", \"ns_per_op_min\": " << res.ns_min << ", \"ns_per_op_median\": " << res.ns_median << ", \"ns_per_op_max\": " << res.ns_max;
+            out << ", \"ops_per_sec\": " << (res.ns_median > 0.0 ? 1e9 / res.ns_median : 0.0) << "}" << (a + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n  \"skipped\": [\n";
+        for (std::size_t a = 0; a < skipped.size(); a++){
+            out << "    {\"name\": \"" << json_escape(skipped[a].first) << "\", \"reason\": \"" << json_escape(skipped[a].second) << "\"}" << (a + 1 < skipped.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+static std::string generate_dbc(std::size_t message_count){
+    std::ostringstream out;
+    out << "VERSION \"\"\n\nBU_: Master Node\n\n";
+    for (std::size_t a = 0; a < message_count; a++){
+        out << "BO_ " << a + 1 << " Message_" << a << ": 8 Node\n";
+        out << " SG_ Counter : 0|8@1+ (1,0) [0|255] \"\"  Master\n";
+        out << " SG_ State : 8|4@1+ (1,0) [0|15] \"\"  Master\n";
+        out << " SG_ Speed : 23|16@0- (0.01,0) [0|0] \"m/s\"  Master\n";
+        out << " SG_ Position : 32|32@1- (0.001,-100) [0|0] \"m\"  Master\n\n";
+    }
+    for (std::size_t a = 0; a < message_count; a++){
+        out << "VAL_ " << a + 1 << " State 0 \"IDLE\" 1 \"RUNNING\" 2 \"FAULT\" ;\n";
+    }
+    return out.str();
+}
+static int write_temp_file(const std::string& contents, std::string* out_path){
+    char path[] = "/tmp/wreathdbc_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    for (std::size_t done = 0; done < contents.size();){
+        ssize_t res = write(fd, contents.data() + done, contents.size() - done);
+        if (res <= 0){
+            close(fd);
+            return 1;
+        }
+        done += res;
+    }
+    close(fd);
+    *out_path = path;
+    return 0;
+}
+static int load_database(const std::string& path, Wreath::DBC::Database* out_database){
+    std::ifstream dbc_file(path);
+    if (!dbc_file.is_open()) return 1;
+    *out_database = {};
+    return out_database->from_file(dbc_file);
+}
+static Wreath::DBC::Signal make_signal(const char* name, std::size_t bit_start, std::size_t bit_length, bool is_little_endian){
+    Wreath::DBC::Signal signal{};
+    signal.name = name;
+    signal.bit_start = bit_start;
+    signal.bit_length = bit_length;
+    signal.factor = 1.0f;
+    signal.is_little_endian = is_little_endian;
+    return signal;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+//Names carry the real message count so results from different --messages runs are never compared by mistake
+static std::string generated_label(std::size_t message_count){
+    if (message_count % 1000 == 0) return "generated_" + std::to_string(message_count / 1000) + "k";
+    return "generated_" + std::to_string(message_count);
+}
+
+static void bench_parse(Bench_Suite* suite, const std::string& odrive_path, const std::string& generated_path, std::size_t message_count){
+    Wreath::DBC::Database database;
+    if (load_database(odrive_path, &database)) suite->skip("parse/from_file/odrive", "failed to load '" + odrive_path + "'");
+    else suite->run("parse/from_file/odrive", [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            load_database(odrive_path, &database);
+            do_not_optimize(database.objects.data());
+        }
+    });
+    std::string label = generated_label(message_count);
+    suite->run("parse/from_file/" + label, [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            load_database(generated_path, &database);
+            do_not_optimize(database.objects.data());
+        }
+    });
+    std::string middle_name = "Message_" + std::to_string(message_count / 2);
+    suite->run("parse/from_file_lazy_first_lookup/" + label, [&](std::size_t count){
+        Wreath::DBC::Message* message_ref;
+        for (std::size_t a = 0; a < count; a++){
+            database = {};
+            database.from_file_lazy(generated_path.c_str());
+            database.get_message_bname(middle_name, &message_ref);
+            do_not_optimize(message_ref);
+        }
+    });
+}
+
+static void bench_lookup(Bench_Suite* suite, Wreath::DBC::Database& database){
+    std::mt19937_64 rng(42);
+    std::vector<std::size_t> ids;
+    std::vector<std::string> names;
+    for (std::size_t a = 0; a < 4096; a++){
+        const Wreath::DBC::Message& message = database.objects[rng() % database.objects.size()];
+        ids.push_back(message.id);
+        names.push_back(message.name);
+    }
+
+    std::string label = generated_label(database.objects.size());
+    Wreath::DBC::Message* message_ref;
+    suite->run("lookup/get_message_bid/" + label, [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            database.get_message_bid(ids[a & 4095], &message_ref);
+            do_not_optimize(message_ref);
+        }
+    });
+    suite->run("lookup/get_message_bname/" + label, [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            database.get_message_bname(names[a & 4095], &message_ref);
+            do_not_optimize(message_ref);
+        }
+    });
+}
+
+static void bench_codec(Bench_Suite* suite){
+    Wreath::DBC::Message intel{};
+    intel.id = 0x100;
+    intel.length = 8;
+    intel.add_signal(make_signal("Aligned_A", 0, 16, true));
+    intel.add_signal(make_signal("Aligned_B", 16, 16, true));
+    intel.add_signal(make_signal("Unaligned_A", 35, 13, true));
+    intel.add_signal(make_signal("Unaligned_B", 50, 11, true));
+
+    Wreath::DBC::Message motorola{};
+    motorola.id = 0x101;
+    motorola.length = 8;
+    motorola.add_signal(make_signal("Aligned_A", 7, 16, false));
+    motorola.add_signal(make_signal("Aligned_B", 23, 16, false));
+    motorola.add_signal(make_signal("Unaligned_A", 36, 13, false));
+    motorola.add_signal(make_signal("Unaligned_B", 54, 11, false));
+
+    can_frame frame{};
+    std::uintmax_t out_a, out_b, out_c, out_d;
+    for (const Wreath::DBC::Message* message : {&intel, &motorola}){
+        std::string layout = message->signals[0].is_little_endian ? "intel" : "motorola";
+        suite->run("codec/package_dbc_message/" + layout, [&](std::size_t count){
+            for (std::size_t a = 0; a < count; a++){
+                Wreath::DBC::Package::package_dbc_message(*message, 0, &frame, (std::uintmax_t)a, (std::uintmax_t)a + 1, (std::uintmax_t)a + 2, (std::uintmax_t)a + 3);
+                do_not_optimize(frame);
+            }
+        });
+        suite->run("codec/unpackage_dbc_message/" + layout, [&](std::size_t count){
+            for (std::size_t a = 0; a < count; a++){
+                out_a = out_b = out_c = out_d = 0;
+                Wreath::DBC::Package::unpackage_dbc_message(*message, &frame, &out_a, &out_b, &out_c, &out_d);
+                do_not_optimize(out_a + out_b + out_c + out_d);
+            }
+        });
+        suite->run("codec/extract_raw/" + layout, [&](std::size_t count){
+            std::uint64_t payload = Wreath::DBC::Package::load_payload(&frame);
+            for (std::size_t a = 0; a < count; a++){
+                std::uint64_t sum = 0;
+                for (const Wreath::DBC::Signal& signal : message->signals) sum += Wreath::DBC::Package::extract_raw(signal, payload + a);
+                do_not_optimize(sum);
+            }
+        });
+    }
+
+    __u8 src[8] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0};
+    __u8 dest[8] = {};
+    suite->run("codec/memcpy_bits/aligned", [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            Wreath::DBC::Package::memcpy_bits(dest, src, 2, 0, 32);
+            do_not_optimize(dest);
+        }
+    });
+    suite->run("codec/memcpy_bits/unaligned", [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            Wreath::DBC::Package::memcpy_bits(dest, src, 1, 3, 29);
+            do_not_optimize(dest);
+        }
+    });
+    suite->run("codec/reverse_memcpy_bits/aligned", [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            Wreath::DBC::Package::reverse_memcpy_bits(dest, src, 2, 0, 32);
+            do_not_optimize(dest);
+        }
+    });
+    suite->run("codec/reverse_memcpy_bits/unaligned", [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            Wreath::DBC::Package::reverse_memcpy_bits(dest, src, 1, 3, 29);
+            do_not_optimize(dest);
+        }
+    });
+}
+
+static void bench_filter(Bench_Suite* suite, const Wreath::DBC::Database& database){
+    Wreath::DBC::Filter::Delta_Filter filter;
+    if (filter.init(database)){
+        suite->skip("filter/delta_filter", "database has signals outside a classic payload");
+        return;
+    }
+    std::vector<std::size_t> changed;
+    can_frame frame{};
+    frame.can_id = database.objects.front().id;
+    frame.len = 8;
+    suite->run("filter/delta_filter/repeat", [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++) do_not_optimize(filter.filter_frame(&frame, &changed));
+    });
+    suite->run("filter/delta_filter/change", [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            frame.data[0] = a;
+            do_not_optimize(filter.filter_frame(&frame, &changed));
+        }
+    });
+}
+
+static void bench_trigger(Bench_Suite* suite, const Wreath::DBC::Database& database){
+    Wreath::DBC::Trigger::Trigger_Set triggers;
+    if (triggers.init(database) || triggers.add_trigger("Position > 12.5 && Speed < -3 for 10 ms")){
+        suite->skip("filter/trigger", "cannot compile trigger against generated database");
+        return;
+    }
+    std::vector<std::size_t> fired;
+    can_frame frame{};
+    frame.can_id = database.objects.front().id;
+    frame.len = 8;
+    suite->run("filter/trigger/raw_compare", [&](std::size_t count){
+        for (std::size_t a = 0; a < count; a++){
+            frame.data[4] = a;
+            do_not_optimize(triggers.evaluate_frame(&frame, a * 1000, &fired));
+        }
+    });
+}
+
+static void bench_io(Bench_Suite* suite, const std::string& interface){
+    int tx_socket = Wreath::CAN::create_socket(CAN_RAW);
+    int rx_socket = Wreath::CAN::create_socket(CAN_RAW);
+    if (tx_socket < 0 || rx_socket < 0 || Wreath::CAN::bind_socket(tx_socket, interface.c_str()) < 0 || Wreath::CAN::bind_socket(rx_socket, interface.c_str()) < 0){
+        suite->skip("io/read_write_bus/" + interface, "cannot bind to '" + interface + "'");
+        suite->skip("io/write_bus_batch/" + interface, "cannot bind to '" + interface + "'");
+        if (tx_socket >= 0) Wreath::CAN::close_socket(tx_socket);
+        if (rx_socket >= 0) Wreath::CAN::close_socket(rx_socket);
+        return;
+    }
+
+    //A lost frame would otherwise block read_bus forever
+    timeval timeout{1, 0};
+    setsockopt(rx_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    can_frame frame{};
+    frame.can_id = 0x123;
+    frame.len = 8;
+    bool failed = false;
+    suite->run("io/read_write_bus/" + interface, [&](std::size_t count){
+        can_frame received;
+        for (std::size_t a = 0; a < count && !failed; a++){
+            if (Wreath::CAN::write_bus(tx_socket, frame) != sizeof(can_frame) || Wreath::CAN::read_bus(rx_socket, &received) != sizeof(can_frame)) failed = true;
+            do_not_optimize(received);
+        }
+    });
+    if (failed) suite->fail("io/read_write_bus/" + interface, "write or read on '" + interface + "' failed");
+
+    std::vector<can_frame> frames(32, frame);
+    failed = false;
+    suite->run("io/write_bus_batch/" + interface, [&](std::size_t count){
+        can_frame received;
+        for (std::size_t a = 0; a < count && !failed; a += frames.size()){
+            ssize_t sent = Wreath::CAN::write_bus_batch(tx_socket, frames.data(), frames.size());
+            if (sent <= 0) failed = true;
+            for (ssize_t b = 0; b < sent && !failed; b++) failed = Wreath::CAN::read_bus(rx_socket, &received) != sizeof(can_frame);
+            do_not_optimize(received);
+        }
+    });
+    if (failed) suite->fail("io/write_bus_batch/" + interface, "write or read on '" + interface + "' failed");
+
+    Wreath::CAN::close_socket(tx_socket);
+    Wreath::CAN::close_socket(rx_socket);
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv){
+    std::string odrive_path = WREATHDBC_SOURCE_DIR "/examples/odrive_cansimple.dbc";
+    std::string interface = "vcan0";
+    std::string output_path;
+    std::size_t message_count = 10000;
+    Bench_Suite suite;
+
+    for (int a = 1; a < argc; a++){
+        std::string arg = argv[a];
+        if (arg == "--dbc" && a + 1 < argc) odrive_path = argv[++a];
+        else if (arg == "--interface" && a + 1 < argc) interface = argv[++a];
+        else if (arg == "--output" && a + 1 < argc) output_path = argv[++a];
+        else if (arg == "--messages" && a + 1 < argc) message_count = std::stoull(argv[++a]);
+        else if (arg == "--min-time" && a + 1 < argc) suite.min_time = std::stod(argv[++a]);
+        else{
+            std::cerr << "Usage: " << argv[0] << " [--dbc path] [--interface vcan0] [--output results.json] [--messages 10000] [--min-time seconds]\n";
+            return 1;
+        }
+    }
+    if (!message_count){
+        std::cerr << "Error: --messages must be at least 1\n";
+        return 1;
+    }
+
+    if (!optimized) std::cerr << "Warning: Benchmarks built without optimization (build type '" WREATHDBC_BUILD_TYPE "'), results are not representative\n";
+
+    std::string generated_path;
+    if (write_temp_file(generate_dbc(message_count), &generated_path)){
+        std::cerr << "Error: Failed to write generated DBC file\n";
+        return 1;
+    }
+    Wreath::DBC::Database generated;
+    if (load_database(generated_path, &generated)){
+        std::cerr << "Error: Failed to parse generated DBC file\n";
+        unlink(generated_path.c_str());
+        return 1;
+    }
+
+    bench_parse(&suite, odrive_path, generated_path, message_count);
+    bench_lookup(&suite, generated);
+    bench_codec(&suite);
+    bench_filter(&suite, generated);
+    bench_trigger(&suite, generated);
+    bench_io(&suite, interface);
+    unlink(generated_path.c_str());
+
+    if (output_path.empty()){
+        suite.write_json(std::cout);
+        return 0;
+    }
+    std::ofstream output(output_path);
+    if (!output.is_open()){
+        std::cerr << "Error: Failed to open output at path '" << output_path << "'\n";
+        return 1;
+    }
+    suite.write_json(output);
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "wreath/can/isotp.hpp"
+
+//Without arguments, runs the Sender/Receiver state machines against each other in memory.
+//With an interface name (e.g. vcan0), also sends the same payloads between two links over it:
+//    sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+
+static constexpr canid_t request_id = 0x7E0;
+static constexpr canid_t response_id = 0x7E8;
+static const std::size_t payload_sizes[] = {1, 7, 8, 62, 4095, 5000};
+
+static std::vector<__u8> make_payload(std::size_t len){
+    std::vector<__u8> payload(len);
+    for (std::size_t a = 0; a < len; a++) payload[a] = a * 7;
+    return payload;
+}
+
+static can_frame make_frame(std::initializer_list<__u8> data){
+    can_frame frame{};
+    frame.can_id = request_id;
+    frame.len = data.size();
+    std::copy(data.begin(), data.end(), frame.data);
+    return frame;
+}
+
+static int check_offline(Wreath::CAN::Buffer_Pool* pool){
+    Wreath::CAN::ISOTP::Options options;
+    options.block_size = 8;
+
+    for (std::size_t len : payload_sizes){
+        std::vector<__u8> src = make_payload(len);
+        Wreath::CAN::ISOTP::Sender sender;
+        Wreath::CAN::ISOTP::Receiver receiver;
+        Wreath::CAN::ISOTP::Payload payload;
+        can_frame frame, flow_control;
+        bool send_flow_control;
+        receiver.pool = pool;
+
+        int sent = sender.start(src.data(), len, request_id, options, &frame);
+        int received = receiver.process(frame, response_id, options, &payload, &flow_control, &send_flow_control);
+        while (sent == 2){
+            sent = sender.next_consecutive(request_id, options, &frame);
+            received = receiver.process(frame, response_id, options, &payload, &flow_control, &send_flow_control);
+        }
+        if (received || payload.len != len || !std::equal(src.begin(), src.end(), payload.data)){
+            std::cerr << "Error: Offline round trip of " << len << " bytes failed\n";
+            return 1;
+        }
+        pool->release(payload.data);
+    }
+
+    //First frames announcing less than a single frame could carry must be ignored, not reassembled
+    Wreath::CAN::ISOTP::Receiver receiver;
+    Wreath::CAN::ISOTP::Payload payload;
+    can_frame flow_control;
+    bool send_flow_control;
+    receiver.pool = pool;
+    can_frame short_first = make_frame({0x10, 0x03, 1, 2, 3, 4, 5, 6});
+    can_frame short_escape = make_frame({0x10, 0x00, 0x00, 0x00, 0x0F, 0xFF, 1, 2});
+    can_frame consecutive = make_frame({0x21, 1, 2, 3, 4, 5, 6, 7});
+    if (receiver.process(short_first, response_id, {}, &payload, &flow_control, &send_flow_control) != 1 ||
+        receiver.process(short_escape, response_id, {}, &payload, &flow_control, &send_flow_control) != 1 ||
+        receiver.process(consecutive, response_id, {}, &payload, &flow_control, &send_flow_control) != 2 || receiver.busy()){
+        std::cerr << "Error: Malformed first frame was accepted\n";
+        return 1;
+    }
+
+    //Payloads larger than the pool's buffers, and empty payloads, must be refused rather than copied
+    Wreath::CAN::Buffer_Pool small_pool;
+    Wreath::CAN::ISOTP::Sender sender;
+    can_frame frame;
+    receiver.pool = &small_pool;
+    if (small_pool.init(1, 4) || receiver.process(make_frame({0x07, 1, 2, 3, 4, 5, 6, 7}), response_id, {}, &payload, &flow_control, &send_flow_control) != 1 ||
+        sender.start(nullptr, 0, request_id, {}, &frame) != 1){
+        std::cerr << "Error: Oversized single frame or empty payload was accepted\n";
+        return 1;
+    }
+
+    std::cout << "Offline: " << std::size(payload_sizes) << " payload sizes round-tripped, malformed frames rejected\n";
+    return 0;
+}
+
+static int check_loopback(Wreath::CAN::Buffer_Pool* pool, const char* interface){
+    Wreath::CAN::ISOTP::Link client;
+    Wreath::CAN::ISOTP::Link server;
+    Wreath::CAN::ISOTP::Options options;
+    options.block_size = 8;
+
+    for (bool userspace : {false, true}){
+        options.force_userspace = userspace;
+        if (client.open(interface, request_id, response_id, pool, options) || server.open(interface, response_id, request_id, pool, options)){
+            std::cerr << "Error: Failed to open ISO-TP links on '" << interface << "'\n";
+            return 1;
+        }
+
+        for (std::size_t len : payload_sizes){
+            std::vector<__u8> src = make_payload(len);
+            Wreath::CAN::ISOTP::Payload payload;
+            int received = 1;
+            std::thread receiver([&](){received = server.recv(&payload, 1000);});
+            int sent = client.send(src.data(), len);
+            receiver.join();
+            if (sent || received || payload.len != len || !std::equal(src.begin(), src.end(), payload.data)){
+                std::cerr << "Error: Loopback of " << len << " bytes over '" << interface << "' failed\n";
+                if (!received) pool->release(payload.data);
+                return 1;
+            }
+            pool->release(payload.data);
+        }
+        std::cout << "Loopback (" << (client.kernel ? "kernel" : "userspace") << "): " << std::size(payload_sizes) << " payload sizes round-tripped over '" << interface << "'\n";
+        client.close();
+        server.close();
+    }
+    return 0;
+}
+
+int main(int argc, char** argv){
+    Wreath::CAN::Buffer_Pool pool;
+    if (pool.init(4, 8192)){
+        std::cerr << "Error: Failed to allocate buffer pool\n";
+        return 1;
+    }
+    if (check_offline(&pool)) return 1;
+    if (argc > 1 && check_loopback(&pool, argv[1])) return 1;
+    return 0;
+}
@@ -17,21 +17,33 @@ static_assert(
 struct odrive_heartbeat{
     std::uint32_t axis_error;
     std::uint8_t axis_state;
-    std::uint8_t motor_error_flag;
-    std::uint8_t encoder_error_flag;
-    std::uint8_t controller_error_flag : 7;
+    std::uint8_t motor_error_flag : 1;
+    std::uint8_t : 7;
+    std::uint8_t encoder_error_flag : 1;
+    std::uint8_t : 7;
+    std::uint8_t controller_error_flag : 1;
+    std::uint8_t : 6;
     std::uint8_t trajectory_done_flag : 1;
 } __attribute__((packed));
 static_assert(
     sizeof(odrive_heartbeat) == 8,
     "Error: Sizeof 'odrive_heartbeat' must be 8 bytes\n"
 );
+static const std::vector<Wreath::CAN::Serial::Overlay_Field> odrive_heartbeat_fields{
+    {"Axis_Error", 0, 32},
+    {"Axis_State", 32, 8},
+    {"Motor_Error_Flag", 40, 1},
+    {"Encoder_Error_Flag", 48, 1},
+    {"Controller_Error_Flag", 56, 1},
+    {"Trajectory_Done_Flag", 63, 1}
+};
 
 int main(int argc, char** argv){
     Wreath::DBC::Message adc_voltage_msg;
     Wreath::DBC::Message heartbeat_msg;
     Wreath::DBC::Database dbc_db;
     odrive_adc_voltage adc_voltage;
+    Wreath::CAN::Serial::Overlay heartbeat_overlay;
     odrive_heartbeat heartbeat;
     std::ifstream dbc_file;
     can_frame frame;
@@ -58,6 +70,10 @@ int main(int argc, char** argv){
         std::cerr << "Error: Failed to find 'Axis2_Heartbeat' in DBC database\n";
         return 1;
     }
+    if (heartbeat_overlay.init<odrive_heartbeat>(heartbeat_msg, odrive_heartbeat_fields)){
+        std::cerr << "Error: 'odrive_heartbeat' does not match 'Axis2_Heartbeat' in DBC database\n";
+        return 1;
+    }
     if ((can_socket = Wreath::CAN::create_socket(CAN_RAW)) < 0){
         std::cerr << "Error: Failed to create CAN socket\n";
         return 1;
@@ -70,9 +86,8 @@ int main(int argc, char** argv){
     while (true){
         ssize_t bytes_read = Wreath::CAN::read_bus(can_socket, &frame);
         if (bytes_read != sizeof(frame)) continue;
-        if (frame.can_id != heartbeat_msg.id) continue;
+        if (heartbeat_overlay.deserial(&heartbeat, frame)) continue;
 
-        Wreath::CAN::Serial::direct_deserial(&heartbeat, frame);
         std::cout << "Axis0_Heartbeat: ";
         std::cout << "    Axis_Error: "            << heartbeat.axis_error << " ";
         std::cout << "    Axis_State: "            << heartbeat.axis_state << " ";
@@ -7,19 +7,31 @@
 struct odrive_heartbeat{
     std::uint32_t axis_error;
     std::uint8_t axis_state;
-    std::uint8_t motor_error_flag;
-    std::uint8_t encoder_error_flag;
-    std::uint8_t controller_error_flag : 7;
+    std::uint8_t motor_error_flag : 1;
+    std::uint8_t : 7;
+    std::uint8_t encoder_error_flag : 1;
+    std::uint8_t : 7;
+    std::uint8_t controller_error_flag : 1;
+    std::uint8_t : 6;
     std::uint8_t trajectory_done_flag : 1;
 } __attribute__((packed));
 static_assert(
     sizeof(odrive_heartbeat) == 8,
     "Error: Sizeof odrive_heartbeat must be 8 bytes\n"
 );
+static const std::vector<Wreath::CAN::Serial::Overlay_Field> odrive_heartbeat_fields{
+    {"Axis_Error", 0, 32},
+    {"Axis_State", 32, 8},
+    {"Motor_Error_Flag", 40, 1},
+    {"Encoder_Error_Flag", 48, 1},
+    {"Controller_Error_Flag", 56, 1},
+    {"Trajectory_Done_Flag", 63, 1}
+};
 
 int main(int argc, char** argv){
     Wreath::DBC::Message heartbeat_msg;
     Wreath::DBC::Database dbc_db;
+    Wreath::CAN::Serial::Overlay heartbeat_overlay;
     odrive_heartbeat heartbeat;
     std::ifstream dbc_file;
     can_frame frame;
@@ -42,6 +54,10 @@ int main(int argc, char** argv){
         std::cerr << "Error: Failed to find 'Axis0_Heartbeat' in DBC database\n";
         return 1;
     }
+    if (heartbeat_overlay.init<odrive_heartbeat>(heartbeat_msg, odrive_heartbeat_fields)){
+        std::cerr << "Error: 'odrive_heartbeat' does not match 'Axis0_Heartbeat' in DBC database\n";
+        return 1;
+    }
 
     heartbeat.axis_error = 1;
     heartbeat.axis_state = 2;
@@ -59,12 +75,12 @@ int main(int argc, char** argv){
     std::cout << +heartbeat.trajectory_done_flag << " ";
     std::cout << "\n";
 
-    Wreath::CAN::Serial::direct_serial(&frame, &heartbeat, heartbeat_msg);
+    heartbeat_overlay.serial(&frame, &heartbeat);
     std::cout << "Encoded Data: ";
     for (__u8 byte : frame.data) std::cout << +byte << " ";
     std::cout << "\n";
     
-    Wreath::CAN::Serial::direct_deserial(&heartbeat, frame);
+    heartbeat_overlay.deserial(&heartbeat, frame);
     std::cout << "Decoded Data: ";
     std::cout << +heartbeat.axis_error << " ";
     std::cout << +heartbeat.axis_state << " ";
@@ -17,6 +17,10 @@ int bind_socket(int socket, const char* can_id, sockaddr_can* out_addr = nullptr
 
 ssize_t read_bus(int socket, can_frame* out_frame);
 ssize_t write_bus(int socket, can_frame frame);
+ssize_t write_bus_batch(int socket, const can_frame* frames, std::size_t count);
+//Retries the unsent tail until every frame is written: ENOBUFS only means the device queue is full.
+//Returns 1 on a write error, or with errno ETIMEDOUT after 'stall_timeout_ms' (-1 forever) without progress
+int write_bus_all(int socket, const can_frame* frames, std::size_t count, int stall_timeout_ms);
 
 //---------------------------------------------------------------------------------------------------------
 
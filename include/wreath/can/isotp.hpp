@@ -0,0 +1,94 @@
+#ifndef WREATH_CAN_ISOTP_HEADER
+#define WREATH_CAN_ISOTP_HEADER
+
+#include <cstdint>
+
+#include <linux/can/raw.h>
+
+#include "wreath/can/pool.hpp"
+
+namespace Wreath{
+namespace CAN{
+namespace ISOTP{
+
+//---------------------------------------------------------------------------------------------------------
+
+struct Options{
+    __u8 block_size = 0;
+    __u8 st_min = 0;
+    __u8 padding = 0xCC;
+    bool use_padding = true;
+    bool force_userspace = false;
+    int timeout_ms = 1000;
+};
+
+//'data' is a buffer from the link's pool, hand it back with Buffer_Pool::release once consumed
+struct Payload{
+    __u8* data = nullptr;
+    std::size_t len = 0;
+};
+
+std::uint64_t st_min_to_ns(__u8 st_min);
+
+//---------------------------------------------------------------------------------------------------------
+
+//Userspace segmentation/reassembly state machines, usable without a socket
+struct Sender{
+    const __u8* data = nullptr;
+    std::size_t len = 0;
+    std::size_t offset = 0;
+    __u8 next_seq = 0;
+
+    //Returns 0 if the whole payload fit in a single frame, 2 if consecutive frames must follow, 1 if 'src_len' is 0 or too large
+    int start(const __u8* src, std::size_t src_len, canid_t tx_id, const Options& options, can_frame* out_frame);
+    int next_consecutive(canid_t tx_id, const Options& options, can_frame* out_frame);
+    bool done() const;
+};
+
+struct Receiver{
+    Buffer_Pool* pool = nullptr;
+    __u8* buffer = nullptr;
+    std::size_t expected = 0;
+    std::size_t received = 0;
+    std::size_t block_count = 0;
+    __u8 next_seq = 0;
+
+    //Returns 0 once a payload is complete, 2 if more frames are needed, 1 on a protocol error.
+    //When 'out_send_flow_control' is set, 'out_flow_control' must be sent back to the peer
+    int process(const can_frame& frame, canid_t tx_id, const Options& options, Payload* out_payload, can_frame* out_flow_control, bool* out_send_flow_control);
+    bool busy() const;
+    void reset();
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+//One ISO-TP session between a tx/rx CAN ID pair. Uses the kernel CAN_ISOTP socket when it is
+//available, otherwise a raw socket driven by Sender/Receiver. Any number of links may share one pool
+struct Link{
+    Options options;
+    Receiver receiver;
+    Buffer_Pool* pool = nullptr;
+    canid_t tx_id = 0;
+    canid_t rx_id = 0;
+    bool kernel = false;
+    int socket = -1;
+
+    int open(const char* interface, canid_t link_tx_id, canid_t link_rx_id, Buffer_Pool* link_pool, const Options& link_options = {});
+    int close();
+    int send(const __u8* data, std::size_t len);
+    //Waits up to 'timeout_ms' (-1 forever) for a payload to start. Returns 2 if none arrived
+    int recv(Payload* out_payload, int timeout_ms = -1);
+
+    int open_kernel(const char* interface);
+    int open_userspace(const char* interface);
+    int wait_frame(can_frame* out_frame, int timeout_ms);
+    int wait_flow_control(__u8* out_block_size, std::uint64_t* out_st_min_ns);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
+
+#endif
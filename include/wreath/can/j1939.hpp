@@ -0,0 +1,87 @@
+#ifndef WREATH_CAN_J1939_HEADER
+#define WREATH_CAN_J1939_HEADER
+
+#include <unordered_map>
+#include <cstdint>
+#include <vector>
+
+#include <linux/can/raw.h>
+
+#include "wreath/can/pool.hpp"
+
+namespace Wreath{
+namespace CAN{
+namespace J1939{
+
+//---------------------------------------------------------------------------------------------------------
+
+constexpr std::uint32_t pgn_tp_cm = 0xEC00;
+constexpr std::uint32_t pgn_tp_dt = 0xEB00;
+constexpr __u8 address_global = 0xFF;
+constexpr __u8 address_null = 0xFE;
+constexpr std::size_t max_transport_size = 1785;
+
+//J1939-21 transport timeouts: T1 between data packets, T2 from a CTS to the next data packet
+constexpr std::uint64_t t1_ns = 750000000;
+constexpr std::uint64_t t2_ns = 1250000000;
+
+//PDU1 PGNs (PF < 240) carry a destination address in PS, which is not part of the PGN
+struct Id{
+    std::uint32_t pgn;
+    __u8 priority;
+    __u8 source_address;
+    __u8 destination_address;
+};
+
+std::uint32_t pgn_of(canid_t can_id);
+Id decode_id(canid_t can_id);
+canid_t encode_id(const Id& id);
+
+//---------------------------------------------------------------------------------------------------------
+
+struct Transfer{
+    __u8* buffer = nullptr;
+    std::uint64_t deadline_ns = 0;
+    std::uint32_t pgn = 0;
+    std::size_t size = 0;
+    std::size_t packets = 0;
+    std::size_t received = 0;
+    std::size_t window_end = 0;
+    std::size_t max_per_cts = 0;
+    bool broadcast = false;
+    bool respond = false;
+};
+
+//'data' is a pooled buffer, hand it back with Buffer_Pool::release once consumed
+struct Transport_Message{
+    Id id;
+    __u8* data;
+    std::size_t len;
+};
+
+//Reassembles BAM and CMDT transfers. RTS frames addressed to 'own_address' are answered with
+//CTS/EoMA through 'out_response'. Transfers between other nodes are reassembled passively
+struct Transport{
+    std::unordered_map<std::uint16_t, Transfer> sessions;
+    Buffer_Pool* pool = nullptr;
+    __u8 own_address = address_null;
+    __u8 packets_per_cts = 16;
+
+    ~Transport();
+
+    //Returns 0 once a transfer completes, 2 if the frame was consumed or is not transport traffic, 1 on a protocol error.
+    //'timestamp_ns' is any monotonic clock, the same one later passed to expire
+    int process(const can_frame& frame, std::uint64_t timestamp_ns, Transport_Message* out_message, can_frame* out_response, bool* out_send_response);
+    void abort(__u8 source_address, __u8 destination_address);
+    //Drops sessions whose sender went quiet for longer than T1 (T2 after a CTS) and returns their buffers to the pool.
+    //Returns the number dropped; a timeout abort is appended to 'out_aborts' for each CMDT session we were answering
+    std::size_t expire(std::uint64_t now_ns, std::vector<can_frame>* out_aborts = nullptr);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef WREATH_CAN_POOL_HEADER
+#define WREATH_CAN_POOL_HEADER
+
+#include <vector>
+#include <mutex>
+
+#include <linux/can/raw.h>
+
+namespace Wreath{
+namespace CAN{
+
+//---------------------------------------------------------------------------------------------------------
+
+//Fixed set of equally sized buffers allocated once up front, shared by transport sessions
+struct Buffer_Pool{
+    std::vector<__u8> storage;
+    std::vector<__u8*> free_list;
+    std::size_t buffer_size = 0;
+    std::mutex mutex;
+
+    int init(std::size_t buffer_count, std::size_t size);
+    __u8* acquire();
+    void release(__u8* buffer);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+
+#endif
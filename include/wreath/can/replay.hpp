@@ -0,0 +1,58 @@
+#ifndef WREATH_CAN_REPLAY_HEADER
+#define WREATH_CAN_REPLAY_HEADER
+
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+#include <linux/can/raw.h>
+
+namespace Wreath{
+namespace CAN{
+namespace Replay{
+
+//---------------------------------------------------------------------------------------------------------
+
+enum class Log_Format{
+    Candump,
+    ASC
+};
+
+//'channel' points into the mapped log and is only valid while the reader is open
+struct Log_Frame{
+    can_frame frame;
+    std::uint64_t timestamp_ns;
+    std::string_view channel;
+};
+
+struct Log_Reader{
+    const char* data = nullptr;
+    std::size_t size = 0;
+    std::size_t cursor = 0;
+    std::size_t line_number = 0;
+    Log_Format format = Log_Format::Candump;
+    bool hex_ids = true;
+
+    int open(const char* path);
+    int open(const char* path, Log_Format log_format);
+    int close();
+    void rewind();
+
+    //Returns 0 when a frame was read, 2 at end of file, 1 on a malformed line (which is skipped)
+    int next(Log_Frame* out_frame);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+//With 'realtime' set, frames are delivered at their original spacing, otherwise as fast as possible.
+//Replay stops early if the callback returns non-zero
+int replay(Log_Reader* reader, const std::function<int(const Log_Frame&)>& callback, bool realtime);
+int replay_to_socket(Log_Reader* reader, int socket, bool realtime, std::size_t batch_size = 32);
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef WREATH_CAN_SERIALIZATION_HEADER
 #define WREATH_CAN_SERIALIZATION_HEADER
 
+#include <type_traits>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #include <linux/can/raw.h>
 
@@ -12,11 +15,40 @@ namespace CAN{
 namespace Serial{
 
 //Warning: Incredibly easy to screw up while using this. 
-//Only use this if you know the exact format of data on your platform
+//Only use this if you know the exact format of data on your platform. Prefer Overlay, which checks the layout
 void direct_deserial(void* dest, const can_frame& src);
 void direct_serial(can_frame* dest, void* src, const DBC::Message& message);
 void direct_request_serial(can_frame* dest, void* src, const DBC::Message& message);
 
+//---------------------------------------------------------------------------------------------------------
+
+//One field of a packed struct, named after its signal and placed in Intel (payload) bit order
+struct Overlay_Field{
+    std::string name;
+    std::size_t bit_offset;
+    std::size_t bit_width;
+};
+
+//A struct layout verified once against a Message's signals; afterwards every frame costs one bounds-checked memcpy.
+//Only the message's ID and length are kept, so the Message itself does not need to outlive the overlay
+struct Overlay{
+    canid_t id = 0;
+    std::size_t length = 0;
+
+    int init(const DBC::Message& message, std::size_t struct_size, const std::vector<Overlay_Field>& fields);
+    template<typename T>
+    int init(const DBC::Message& message, const std::vector<Overlay_Field>& fields){
+        static_assert(std::is_trivially_copyable_v<T>, "Static Error: Overlay structs must be trivially copyable\n");
+        return init(message, sizeof(T), fields);
+    }
+
+    //Returns 1 if the overlay is not initialized, or the frame has another ID, is a remote frame or is too short
+    int deserial(void* dest, const can_frame& src) const;
+    int serial(can_frame* dest, const void* src) const;
+};
+
+//---------------------------------------------------------------------------------------------------------
+
 }
 }
 }
@@ -1,10 +1,21 @@
 #ifndef WREATH_DBC_HEADER
 #define WREATH_DBC_HEADER
 
+#include <unordered_map>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
+#include <atomic>
+#include <deque>
+#include <mutex>
 
 namespace Wreath{
+namespace CAN{
+namespace J1939{
+struct Id;
+}
+}
 namespace DBC{
 
 struct Signal{
@@ -33,6 +44,7 @@ struct Message{
     std::string name;
     std::size_t length;
     std::size_t id;
+    std::size_t cycle_time;
 
     void add_signal(const Signal& signal);
     int get_signal_bname(const std::string& name, Signal* out_signal) const;
@@ -45,18 +57,80 @@ struct Val_Decl{
     std::size_t object_id;
 };
 
+struct Attr_Decl{
+    std::string attribute_name;
+    std::string value;
+    std::size_t object_id;
+};
+
+struct Val_Type_Decl{
+    std::string signal_name;
+    std::size_t object_id;
+    std::size_t value_type;
+};
+
+struct Lazy_Entry{
+    std::vector<std::pair<std::size_t, std::size_t>> decl_lines;
+    std::mutex mutex;
+    std::atomic<bool> loaded{false};
+    std::size_t body_begin;
+    std::size_t body_end;
+    std::size_t line_number;
+    int result;
+};
+
+//The mapped file is immutable and shared between copies of a Database
+struct Lazy_Mapping{
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+    ~Lazy_Mapping();
+};
+
+//Load state belongs to one Database; copying a Database copies it along with the messages
+struct Lazy_Index{
+    std::unordered_map<std::size_t, Lazy_Entry*> by_id;
+    std::deque<Lazy_Entry> entries;
+    std::shared_ptr<const Lazy_Mapping> mapping;
+};
+
 struct Database{
     std::vector<Message> objects;
     std::vector<std::string> nodes;
     std::string version;
+    std::unique_ptr<Lazy_Index> lazy;
+    std::unordered_map<std::uint32_t, std::vector<std::size_t>> pgn_index; //PGN -> positions in 'objects', lowest ID first
+    bool j1939_mode = false;
+
+    Database() = default;
+    Database(const Database& other);
+    Database(Database&& other) = default;
+    Database& operator=(const Database& other);
+    Database& operator=(Database&& other) = default;
 
     int from_file(std::ifstream& dbc_file);
+    //Only indexes BO_ lines. SG_, VAL_ and SIG_VALTYPE_ lines of a message are parsed on its first
+    //lookup through get_message_bid/get_message_bname (thread-safe), or all at once by load_all().
+    //Code that walks 'objects' directly must call load_all() first. A copy loads independently of its source
+    int from_file_lazy(const char* path);
+    int load_all() const;
+    int load_message(const Message& message) const;
 
     void add_message(const Message& object);
     int get_message_bid(std::size_t id, Message* out_message) const;
     int get_message_bid(std::size_t id, Message** out_message);
     int get_message_bname(std::string name, Message* out_message) const;
     int get_message_bname(std::string name, Message** out_message);
+
+    //J1939 mode: indexes extended-ID messages by PGN, ignoring priority, source and destination address.
+    //A PGN defined once per source ECU resolves by exact CAN ID in get_message_bj1939, other IDs fall back
+    //to the lowest. Once built, the index is kept up to date by add_message
+    int build_j1939_index();
+    void index_j1939_message(std::size_t position);
+    int get_message_bpgn(std::uint32_t pgn, Message* out_message) const;
+    int get_message_bpgn(std::uint32_t pgn, Message** out_message);
+    int get_message_bj1939(std::size_t can_id, Message* out_message, CAN::J1939::Id* out_id) const;
+    int get_message_bj1939(std::size_t can_id, Message** out_message, CAN::J1939::Id* out_id);
 };
 
 }
@@ -0,0 +1,50 @@
+#ifndef WREATH_DBC_FILTER_HEADER
+#define WREATH_DBC_FILTER_HEADER
+
+#include <unordered_map>
+#include <cstdint>
+
+#include <linux/can/raw.h>
+
+#include "wreath/dbc/database.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Filter{
+
+//---------------------------------------------------------------------------------------------------------
+
+struct Delta_Signal{
+    std::uint64_t mask;
+    double deadband;
+    double last_value;
+};
+
+struct Delta_State{
+    std::vector<Delta_Signal> signals;
+    const Message* message;
+    std::uint64_t last_payload;
+    __u8 last_len;
+    bool has_payload;
+};
+
+//Keeps the last payload per CAN ID and reports only the signals whose bits changed.
+//Holds pointers into the Database, so the Database must outlive the filter and not be modified
+struct Delta_Filter{
+    std::unordered_map<canid_t, Delta_State> states;
+
+    int init(const Database& database);
+    int set_deadband(std::size_t id, const std::string& signal_name, double deadband);
+    void reset();
+
+    //Returns 0 if any signal changed, 2 if the frame is a repeat or a remote request, 1 if the CAN ID is unknown
+    int filter_frame(const can_frame* frame, std::vector<std::size_t>* out_changed);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
+
+#endif
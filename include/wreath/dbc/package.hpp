@@ -1,6 +1,8 @@
 #ifndef WREATH_DBC_PACKAGE_HEADER
 #define WREATH_DBC_PACKAGE_HEADER
 
+#include <cstdint>
+
 #include <linux/can/raw.h>
 
 #include "wreath/dbc/static_checks.hpp"
@@ -17,6 +19,14 @@ void reverse_memcpy_bits(__u8* dest, const __u8* src, std::size_t sbyte, std::si
 
 //---------------------------------------------------------------------------------------------------------
 
+//Payloads are handled as one little-endian 64-bit word (byte 0 in the low bits)
+std::uint64_t load_payload(const can_frame* frame);
+std::uint64_t signal_mask(const Signal& signal);
+std::uint64_t extract_raw(const Signal& signal, std::uint64_t payload);
+double raw_to_physical(const Signal& signal, std::uint64_t raw);
+
+//---------------------------------------------------------------------------------------------------------
+
 int package_dbc_message(const Message& message, int can_flags, can_frame* out_frame, ...);
 int unpackage_dbc_message(const Message& message, const can_frame* frame, ...);
 
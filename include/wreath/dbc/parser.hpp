@@ -25,6 +25,8 @@ std::string_view::const_iterator absorb_until(const std::string_view::const_iter
 int parse_bo(const std::string_view& line, std::size_t line_number, Message* out_message);
 int parse_sg(const std::string_view& line, std::size_t line_number, Signal* output);
 int parse_val(const std::string_view& line, std::size_t line_number, Val_Decl* output);
+int parse_sig_valtype(const std::string_view& line, std::size_t line_number, Val_Type_Decl* output);
+int parse_ba_bo(const std::string_view& line, std::size_t line_number, Attr_Decl* output);
 
 //---------------------------------------------------------------------------------------------------------
 
@@ -0,0 +1,122 @@
+#ifndef WREATH_DBC_RECORDER_HEADER
+#define WREATH_DBC_RECORDER_HEADER
+
+#include <condition_variable>
+#include <unordered_map>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <span>
+
+#include <linux/can/raw.h>
+
+#include "wreath/dbc/database.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Recorder{
+
+//---------------------------------------------------------------------------------------------------------
+
+//On-disk layout: a header listing every column ("Message.Signal"), followed by independent blocks.
+//Each block holds up to 'block_samples' samples of one column. Timestamps are stored as
+//delta-of-delta, integer signals as deltas and float signals as XOR against the previous value,
+//all zigzag/varint packed with runs of zeros collapsed
+struct Column_Info{
+    std::string name;
+    std::size_t message_id;
+    std::size_t bit_length;
+    float factor;
+    float offset;
+    bool is_signed;
+    bool is_single_float;
+    bool is_double_float;
+};
+
+struct Pending_Block{
+    std::vector<std::uint64_t> timestamps;
+    std::vector<std::uint64_t> raw;
+    std::uint32_t column;
+};
+
+struct Column_Buffer{
+    Signal signal;
+    std::vector<std::uint64_t> timestamps;
+    std::vector<std::uint64_t> raw;
+};
+
+struct Recorder{
+    std::unordered_map<canid_t, std::pair<std::size_t, std::size_t>> messages;
+    std::vector<Column_Buffer> columns;
+    std::size_t block_samples = 1024;
+    //Blocks waiting for the writer thread, never fewer than one per column. Once full, the RX path drops
+    //further blocks and counts them so a stalled disk cannot grow memory without bound; close() waits instead
+    std::size_t max_pending_blocks = 4096;
+    std::atomic<std::size_t> dropped_blocks = 0;
+
+    std::deque<Pending_Block> pending;
+    std::condition_variable pending_cv;
+    std::condition_variable space_cv;
+    std::mutex pending_mutex;
+    std::thread writer;
+    bool stopping = false;
+
+    __u8* staging = nullptr;
+    std::size_t staging_used = 0;
+    std::size_t file_size = 0;
+    bool direct_io = false;
+    bool failed = false;
+    int fd = -1;
+
+    ~Recorder();
+
+    int open(const char* path, const Database& database, bool use_direct_io = false);
+    int close();
+
+    //Called from the RX path. Only appends to in-memory columns, full blocks are handed to the writer thread
+    int record(const can_frame* frame, std::uint64_t timestamp_ns);
+
+    void flush_column(std::uint32_t column, bool wait = false);
+    void writer_loop();
+    int write_bytes(const void* src, std::size_t len);
+    int drain_staging(bool final);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+struct Recording_Column{
+    Column_Info info;
+    std::vector<std::size_t> blocks;
+    std::vector<std::uint64_t> timestamps;
+    std::vector<double> values;
+    bool decoded = false;
+};
+
+struct Recording{
+    std::vector<Recording_Column> columns;
+    const __u8* data = nullptr;
+    std::size_t size = 0;
+
+    //Owns the mapping, so copies would unmap it twice
+    Recording() = default;
+    Recording(const Recording&) = delete;
+    Recording& operator=(const Recording&) = delete;
+    ~Recording();
+
+    int open(const char* path);
+    int close();
+
+    //Spans stay valid until the recording is closed
+    int get_column(const std::string& name, std::span<const std::uint64_t>* out_timestamps, std::span<const double>* out_values);
+    int decode_column(Recording_Column* column);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
+
+#endif
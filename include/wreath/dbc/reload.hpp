@@ -0,0 +1,102 @@
+#ifndef WREATH_DBC_RELOAD_HEADER
+#define WREATH_DBC_RELOAD_HEADER
+
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+
+#include <linux/can/raw.h>
+
+#include "wreath/dbc/database.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Reload{
+
+//---------------------------------------------------------------------------------------------------------
+
+struct Message_Diff{
+    std::vector<std::string> added_signals;
+    std::vector<std::string> removed_signals;
+    std::vector<std::string> changed_signals;
+    std::size_t id;
+};
+
+struct Database_Diff{
+    std::vector<std::size_t> added;
+    std::vector<std::size_t> removed;
+    std::vector<Message_Diff> changed;
+
+    bool empty() const;
+};
+
+//Returns 0 if the messages are identical, 2 if they differ (with the details in 'out_diff')
+int diff_message(const Message& old_message, const Message& new_message, Message_Diff* out_diff);
+int diff_databases(const Database& old_database, const Database& new_database, Database_Diff* out_diff);
+
+//---------------------------------------------------------------------------------------------------------
+
+//Per-message decode plan: the payload mask of every signal, in the order of Message::signals
+struct Message_Plan{
+    std::vector<std::uint64_t> masks;
+};
+
+struct Snapshot_Entry{
+    std::shared_ptr<const Message> message;
+    std::shared_ptr<const Message_Plan> plan;
+};
+
+//Immutable once published. Unchanged messages and their plans are shared with the previous snapshot
+struct Snapshot{
+    std::unordered_map<canid_t, Snapshot_Entry> index;
+    std::vector<std::string> nodes;
+    std::string version;
+    std::uint64_t epoch;
+
+    const Snapshot_Entry* get_message_bid(std::size_t id) const;
+};
+
+struct Reader_Handle{
+    std::atomic<std::uint64_t> observed;
+};
+
+//Quiescent-state based reclamation: readers load the current snapshot without locks and report a
+//quiescent point (where they hold no snapshot pointers) by calling quiescent(). A retired snapshot
+//is freed once every registered reader has passed a quiescent point after it was replaced
+struct Reloader{
+    std::atomic<const Snapshot*> current{nullptr};
+    std::atomic<std::uint64_t> epoch{1};
+
+    std::vector<std::unique_ptr<Reader_Handle>> readers;
+    std::vector<std::pair<const Snapshot*, std::uint64_t>> retired;
+    std::mutex writer_mutex;
+    std::thread worker;
+    std::atomic<bool> reloading{false};
+
+    ~Reloader();
+
+    int load(const Database& database, Database_Diff* out_diff = nullptr);
+    int reload(std::ifstream& dbc_file, Database_Diff* out_diff = nullptr);
+    //Parses on a background thread. 'on_done' runs on that thread with the parse result and the diff.
+    //Returns 2 without starting anything while a previous reload, including its 'on_done', is still running
+    int reload_async(const std::string& path, std::function<void(int, const Database_Diff&)> on_done = nullptr);
+    std::size_t reclaim();
+
+    Reader_Handle* register_reader();
+    void unregister_reader(Reader_Handle* reader);
+    const Snapshot* read() const;
+    void quiescent(Reader_Handle* reader) const;
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef WREATH_DBC_SHARED_HEADER
+#define WREATH_DBC_SHARED_HEADER
+
+#include <string_view>
+#include <cstdint>
+#include <atomic>
+#include <span>
+
+#include "wreath/dbc/database.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Shared{
+
+//---------------------------------------------------------------------------------------------------------
+
+//A published Database is a single relocatable, read-only image: every reference is an offset from
+//the start of the image, so it can be mapped at any address by any number of processes.
+//A small control segment '<name>' holds the current generation, and the image lives in '<name>.<generation>'
+struct String_Ref{
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+struct Flat_Enum{
+    std::uint64_t value;
+    String_Ref text;
+};
+
+struct Flat_Signal{
+    String_Ref name;
+    String_Ref unit;
+    std::uint32_t bit_start;
+    std::uint32_t bit_length;
+    float factor;
+    float offset;
+    float min;
+    float max;
+    std::uint32_t enum_begin;
+    std::uint32_t enum_count;
+    std::uint32_t receiver_begin;
+    std::uint32_t receiver_count;
+    std::uint8_t is_little_endian;
+    std::uint8_t is_signed;
+    std::uint8_t is_single_float;
+    std::uint8_t is_double_float;
+    std::uint32_t reserved;
+};
+
+struct Flat_Message{
+    std::uint64_t id;
+    std::uint64_t length;
+    std::uint64_t cycle_time;
+    String_Ref name;
+    String_Ref sender;
+    std::uint32_t signal_begin;
+    std::uint32_t signal_count;
+};
+
+struct Image_Header{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t message_count;
+    std::uint64_t generation;
+    std::uint64_t size;
+    std::uint64_t messages_offset;
+    std::uint64_t name_index_offset;
+    std::uint64_t signals_offset;
+    std::uint64_t enums_offset;
+    std::uint64_t refs_offset;
+    std::uint64_t strings_offset;
+    std::uint32_t signal_count;
+    std::uint32_t enum_count;
+    std::uint32_t ref_count;
+    std::uint32_t node_begin;
+    std::uint32_t node_count;
+    String_Ref db_version;
+};
+
+struct Control_Block{
+    std::uint64_t magic;
+    std::atomic<std::uint64_t> generation;
+};
+static_assert(
+    std::atomic<std::uint64_t>::is_always_lock_free,
+    "Static Error: 64-bit atomics must be lock-free to live in shared memory\n"
+);
+
+//---------------------------------------------------------------------------------------------------------
+
+int build_image(const Database& database, std::uint64_t generation, std::vector<std::uint8_t>* out_image);
+int publish(const Database& database, const char* name, std::uint64_t* out_generation = nullptr);
+int unpublish(const char* name);
+
+//Views returned by a Shared_Database point into the mapped image and stay valid until the next refresh/detach
+struct Shared_Database{
+    const Image_Header* header = nullptr;
+    const Control_Block* control = nullptr;
+    std::string name;
+
+    //Owns the image and control mappings, so copies would unmap them twice
+    Shared_Database() = default;
+    Shared_Database(const Shared_Database&) = delete;
+    Shared_Database& operator=(const Shared_Database&) = delete;
+    ~Shared_Database();
+
+    int attach(const char* shared_name);
+    int detach();
+    bool is_stale() const;
+    int refresh();
+
+    std::string_view string(String_Ref ref) const;
+    std::span<const Flat_Message> messages() const;
+    std::span<const Flat_Signal> signals(const Flat_Message& message) const;
+    std::span<const Flat_Enum> value_enum(const Flat_Signal& signal) const;
+    std::span<const String_Ref> receivers(const Flat_Signal& signal) const;
+    std::span<const String_Ref> nodes() const;
+
+    int get_message_bid(std::size_t id, const Flat_Message** out_message) const;
+    int get_message_bname(std::string_view message_name, const Flat_Message** out_message) const;
+    int get_signal_bname(const Flat_Message& message, std::string_view signal_name, const Flat_Signal** out_signal) const;
+    int to_message(const Flat_Message& message, Message* out_message) const;
+
+    int map_generation(std::uint64_t generation);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
+
+#endif
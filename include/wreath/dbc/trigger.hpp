@@ -0,0 +1,93 @@
+#ifndef WREATH_DBC_TRIGGER_HEADER
+#define WREATH_DBC_TRIGGER_HEADER
+
+#include <unordered_map>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <linux/can/raw.h>
+
+#include "wreath/dbc/database.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Trigger{
+
+//---------------------------------------------------------------------------------------------------------
+
+//Grammar:
+//  trigger    := expression ["for" number ("us" | "ms" | "s")]
+//  expression := and {"||" and}
+//  and        := unary {"&&" unary}
+//  unary      := "!" unary | "(" expression ")" | signal [compare number] | number compare signal
+//  signal     := "Signal" | "Message.Signal"
+//  compare    := "==" | "!=" | "<" | "<=" | ">" | ">="
+//A bare signal is true when non-zero. Every signal in one trigger must live in the same message;
+//a bare name compiles against every message that has it (so "Axis_Error != 0" watches all axes)
+
+enum class Opcode : std::uint8_t{
+    Constant,
+    Compare_Raw,
+    Compare_Physical,
+    Not,
+    And,
+    Or
+};
+
+enum class Compare : std::uint8_t{
+    Equal,
+    Not_Equal,
+    Less,
+    Less_Equal,
+    Greater,
+    Greater_Equal
+};
+
+//Integer signals compare raw bits against a threshold converted once at compile time.
+//Float signals, and anything wider than 62 bits, are decoded and compared physically
+struct Instruction{
+    Opcode op;
+    Compare compare;
+    bool value;
+    bool swap;
+    bool is_signed;
+    std::uint8_t shift;
+    std::uint8_t bit_length;
+    std::uint64_t mask;
+    std::int64_t raw_threshold;
+    double threshold;
+    const Signal* signal;
+};
+
+struct Program{
+    std::vector<Instruction> code;
+    std::vector<std::uint8_t> stack;
+    std::size_t trigger;
+    std::size_t length;
+    std::uint64_t hold_ns;
+    std::uint64_t since_ns;
+    bool holding;
+};
+
+//Holds pointers into the Database, so the Database must outlive the set and not be modified
+struct Trigger_Set{
+    std::unordered_map<canid_t, std::vector<Program>> programs;
+    std::vector<std::string> expressions;
+    const Database* database = nullptr;
+
+    int init(const Database& database);
+    int add_trigger(const std::string& expression, std::size_t* out_trigger = nullptr);
+    void reset();
+
+    //Returns 0 if any trigger fired, 2 if none did or the frame is a remote request, 1 if no trigger watches the CAN ID
+    int evaluate_frame(const can_frame* frame, std::uint64_t timestamp_ns, std::vector<std::size_t>* out_fired);
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef WREATH_METRICS_HEADER
+#define WREATH_METRICS_HEADER
+
+#include <unordered_map>
+#include <cstdint>
+#include <atomic>
+#include <array>
+#include <mutex>
+
+#include <linux/can/raw.h>
+
+#include "wreath/dbc/database.hpp"
+
+namespace Wreath{
+namespace Metrics{
+
+//---------------------------------------------------------------------------------------------------------
+
+//Always compiled in, off until enabled. Each thread records into its own shard, shards are merged on read
+extern std::atomic<bool> enabled;
+
+inline bool is_enabled(){
+    return enabled.load(std::memory_order_relaxed);
+}
+void set_enabled(bool state);
+std::uint64_t now_ns();
+
+//Log-linear histogram in the style of HDR: 16 linear sub-buckets per power of two (~6% resolution)
+struct Histogram{
+    static constexpr std::size_t sub_bucket_bits = 4;
+    static constexpr std::size_t bucket_count = (64 - sub_bucket_bits + 1) << sub_bucket_bits;
+
+    std::array<std::uint64_t, bucket_count> counts{};
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+    std::uint64_t max = 0;
+
+    static std::size_t bucket_of(std::uint64_t value);
+    static std::uint64_t bucket_upper(std::size_t bucket);
+
+    void record(std::uint64_t value);
+    void merge(const Histogram& other);
+    std::uint64_t percentile(double fraction) const;
+};
+
+//Remote requests are counted on their own; they share the ID but not the period of the data frames
+struct Id_Stats{
+    std::uint64_t frames = 0;
+    std::uint64_t remote_frames = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t first_ns = 0;
+    std::uint64_t last_ns = 0;
+    std::uint64_t periods = 0;
+    double period_sum_ns = 0.0;
+    double period_sq_sum_ns = 0.0;
+};
+
+struct Bus_Stats{
+    std::uint64_t rx_frames = 0;
+    std::uint64_t tx_frames = 0;
+    std::uint64_t bits = 0;
+    std::uint64_t first_ns = 0;
+    std::uint64_t last_ns = 0;
+    std::uint64_t rx_errors = 0;
+    std::uint64_t tx_errors = 0;
+    std::uint64_t dropped = 0;
+};
+
+struct Socket_State{
+    std::uint32_t bitrate = 0;
+    std::atomic<std::uint32_t> last_drop_counter{0};
+};
+
+//The same CAN ID on two buses is two streams, so per-ID stats are keyed by socket and ID
+inline std::uint64_t id_key(int socket, canid_t id){
+    return ((std::uint64_t)(std::uint32_t)socket << 32) | id;
+}
+
+struct Thread_Shard{
+    std::unordered_map<std::uint64_t, Id_Stats> ids;
+    std::unordered_map<int, Bus_Stats> buses;
+    Histogram decode_latency;
+    Histogram encode_latency;
+    std::mutex mutex;
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+//Turns on kernel drop reporting (SO_RXQ_OVFL) for 'socket' and sets the bitrate used for bus load
+int watch_socket(int socket, std::uint32_t bitrate);
+std::size_t frame_bits(const can_frame& frame);
+
+void record_rx(int socket, const can_frame& frame, std::uint64_t timestamp_ns, std::uint32_t drop_counter, bool has_drop_counter);
+void record_tx(int socket, const can_frame& frame, std::uint64_t timestamp_ns);
+void record_rx_error(int socket);
+void record_tx_error(int socket);
+void record_decode(std::uint64_t latency_ns);
+void record_encode(std::uint64_t latency_ns);
+
+//---------------------------------------------------------------------------------------------------------
+
+struct Id_Snapshot{
+    int socket;
+    canid_t id;
+    std::uint64_t frames;
+    std::uint64_t remote_frames;
+    std::uint64_t bytes;
+    double rate_hz;
+    double period_ms;
+    double jitter_ms;
+    double expected_period_ms;
+};
+
+struct Bus_Snapshot{
+    int socket;
+    std::uint64_t rx_frames;
+    std::uint64_t tx_frames;
+    std::uint64_t rx_errors;
+    std::uint64_t tx_errors;
+    std::uint64_t dropped;
+    std::uint32_t bitrate;
+    double load;
+};
+
+struct Snapshot{
+    std::vector<Id_Snapshot> ids;
+    std::vector<Bus_Snapshot> buses;
+    Histogram decode_latency;
+    Histogram encode_latency;
+};
+
+//'database' is optional and supplies GenMsgCycleTime for each ID
+int snapshot(Snapshot* out_snapshot, const DBC::Database* database = nullptr);
+int dump(int fd, const DBC::Database* database = nullptr);
+void reset();
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+
+#endif
@@ -1,11 +1,16 @@
 #include <cstring>
+#include <cerrno>
 #include <cstdarg>
 #include <climits>
+#include <algorithm>
+#include <ctime>
 
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <poll.h>
 
+#include "wreath/metrics/metrics.hpp"
 #include "wreath/can/can.hpp"
 
 namespace Wreath{
@@ -35,10 +40,104 @@ int bind_socket(int socket, const char* can_id, sockaddr_can* out_addr){
 //---------------------------------------------------------------------------------------------------------
 
 ssize_t read_bus(int socket, can_frame* out_frame){
-    return read(socket, out_frame, sizeof(can_frame));
+    if (!Metrics::is_enabled()) return read(socket, out_frame, sizeof(can_frame));
+
+    //recvmsg instead of read so the SO_RXQ_OVFL drop counter comes along when watch_socket enabled it
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(std::uint32_t))];
+    iovec vector{out_frame, sizeof(can_frame)};
+    msghdr header{};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    ssize_t res = recvmsg(socket, &header, 0);
+    if (res != sizeof(can_frame)){
+        //An empty nonblocking socket or an interrupted read is not a bus error
+        if (res >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) Metrics::record_rx_error(socket);
+        return res;
+    }
+    std::uint32_t drop_counter = 0;
+    bool has_drop_counter = false;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg)){
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL){
+            std::memcpy(&drop_counter, CMSG_DATA(cmsg), sizeof(drop_counter));
+            has_drop_counter = true;
+        }
+    }
+    Metrics::record_rx(socket, *out_frame, Metrics::now_ns(), drop_counter, has_drop_counter);
+    return res;
 }
 ssize_t write_bus(int socket, can_frame frame){
-    return write(socket, &frame, sizeof(can_frame));
+    ssize_t res = write(socket, &frame, sizeof(can_frame));
+    if (Metrics::is_enabled()){
+        if (res == sizeof(can_frame)) Metrics::record_tx(socket, frame, Metrics::now_ns());
+        else if (res >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) Metrics::record_tx_error(socket);
+    }
+    return res;
+}
+ssize_t write_bus_batch(int socket, const can_frame* frames, std::size_t count){
+    constexpr std::size_t max_batch = 64;
+    mmsghdr headers[max_batch];
+    iovec vectors[max_batch];
+    std::size_t sent = 0;
+
+    while (sent < count){
+        std::size_t batch = std::min(count - sent, max_batch);
+        for (std::size_t a = 0; a < batch; a++){
+            vectors[a].iov_base = (void*)(frames + sent + a);
+            vectors[a].iov_len = sizeof(can_frame);
+            headers[a] = {};
+            headers[a].msg_hdr.msg_iov = &vectors[a];
+            headers[a].msg_hdr.msg_iovlen = 1;
+        }
+        int res = sendmmsg(socket, headers, batch, 0);
+        if (Metrics::is_enabled()){
+            if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) Metrics::record_tx_error(socket);
+            else{
+                std::uint64_t timestamp = Metrics::now_ns();
+                for (int b = 0; b < res; b++) Metrics::record_tx(socket, frames[sent + b], timestamp);
+            }
+        }
+        if (res < 0) return sent ? (ssize_t)sent : -1;
+        sent += res;
+        if ((std::size_t)res < batch) break;
+    }
+    return sent;
+}
+int write_bus_all(int socket, const can_frame* frames, std::size_t count, int stall_timeout_ms){
+    std::uint64_t stalled_since = 0;
+    while (count){
+        ssize_t sent = write_bus_batch(socket, frames, count);
+        if (sent > 0){
+            frames += sent;
+            count -= sent;
+            stalled_since = 0;
+            continue;
+        }
+        int err = sent < 0 ? errno : EAGAIN;
+        if (err != ENOBUFS && err != EAGAIN && err != EWOULDBLOCK && err != EINTR) return 1;
+
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        std::uint64_t now_ns = (std::uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+        if (!stalled_since) stalled_since = now_ns;
+        std::uint64_t waited_ms = (now_ns - stalled_since) / 1000000;
+        if (stall_timeout_ms >= 0 && waited_ms >= (std::uint64_t)stall_timeout_ms){
+            errno = ETIMEDOUT;
+            return 1;
+        }
+        if (err == EINTR) continue;
+        //CAN sockets report POLLOUT while the device queue is still full, so poll would return at once
+        if (err == ENOBUFS){
+            timespec delay{0, 100000};
+            nanosleep(&delay, nullptr);
+            continue;
+        }
+        pollfd pfd{socket, POLLOUT, 0};
+        poll(&pfd, 1, stall_timeout_ms < 0 ? -1 : stall_timeout_ms - (int)waited_ms);
+    }
+    return 0;
 }
 
 //---------------------------------------------------------------------------------------------------------
@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <linux/can/isotp.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <poll.h>
+
+#include "wreath/can/isotp.hpp"
+#include "wreath/can/can.hpp"
+
+namespace Wreath{
+namespace CAN{
+namespace ISOTP{
+
+//---------------------------------------------------------------------------------------------------------
+
+static constexpr __u8 pci_single = 0x0;
+static constexpr __u8 pci_first = 0x1;
+static constexpr __u8 pci_consecutive = 0x2;
+static constexpr __u8 pci_flow_control = 0x3;
+
+static constexpr __u8 fc_continue = 0x0;
+static constexpr __u8 fc_wait = 0x1;
+static constexpr __u8 fc_overflow = 0x2;
+
+static constexpr std::size_t max_classic_len = 4095;
+static constexpr std::size_t max_batch = 64;
+
+std::uint64_t st_min_to_ns(__u8 st_min){
+    if (st_min <= 0x7F) return (std::uint64_t)st_min * 1000000;
+    if (st_min >= 0xF1 && st_min <= 0xF9) return (std::uint64_t)(st_min - 0xF0) * 100000;
+    return 127000000;
+}
+
+static void finish_frame(can_frame* frame, std::size_t used, const Options& options){
+    if (options.use_padding){
+        std::memset(frame->data + used, options.padding, CAN_MAX_DLEN - used);
+        frame->len = CAN_MAX_DLEN;
+        return;
+    }
+    frame->len = used;
+}
+static void make_flow_control(can_frame* frame, canid_t tx_id, __u8 status, const Options& options){
+    *frame = {};
+    frame->can_id = tx_id;
+    frame->data[0] = (pci_flow_control << 4) | status;
+    frame->data[1] = options.block_size;
+    frame->data[2] = options.st_min;
+    finish_frame(frame, 3, options);
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int Sender::start(const __u8* src, std::size_t src_len, canid_t tx_id, const Options& options, can_frame* out_frame){
+    //An empty single frame is rejected by receivers, and the escape form carries at most 32 bits of length
+    if (!src_len || src_len > 0xFFFFFFFF){
+        std::cerr << "Error (Wreath::CAN::ISOTP): Cannot send a " << src_len << " byte payload\n";
+        return 1;
+    }
+    data = src;
+    len = src_len;
+    *out_frame = {};
+    out_frame->can_id = tx_id;
+    if (len <= 7){
+        out_frame->data[0] = (pci_single << 4) | len;
+        std::memcpy(out_frame->data + 1, data, len);
+        finish_frame(out_frame, len + 1, options);
+        offset = len;
+        return 0;
+    }
+    if (len <= max_classic_len){
+        out_frame->data[0] = (pci_first << 4) | (len >> 8);
+        out_frame->data[1] = len & 0xFF;
+        offset = 6;
+    } else{
+        out_frame->data[0] = pci_first << 4;
+        out_frame->data[1] = 0;
+        out_frame->data[2] = (len >> 24) & 0xFF;
+        out_frame->data[3] = (len >> 16) & 0xFF;
+        out_frame->data[4] = (len >> 8) & 0xFF;
+        out_frame->data[5] = len & 0xFF;
+        offset = 2;
+    }
+    std::memcpy(out_frame->data + CAN_MAX_DLEN - offset, data, offset);
+    out_frame->len = CAN_MAX_DLEN;
+    next_seq = 1;
+    return 2;
+}
+int Sender::next_consecutive(canid_t tx_id, const Options& options, can_frame* out_frame){
+    std::size_t chunk = std::min<std::size_t>(7, len - offset);
+    *out_frame = {};
+    out_frame->can_id = tx_id;
+    out_frame->data[0] = (pci_consecutive << 4) | next_seq;
+    std::memcpy(out_frame->data + 1, data + offset, chunk);
+    finish_frame(out_frame, chunk + 1, options);
+    offset += chunk;
+    next_seq = (next_seq + 1) & 0xF;
+    return done() ? 0 : 2;
+}
+bool Sender::done() const{
+    return offset >= len;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int Receiver::process(const can_frame& frame, canid_t tx_id, const Options& options, Payload* out_payload, can_frame* out_flow_control, bool* out_send_flow_control){
+    *out_send_flow_control = false;
+    if (!frame.len) return 2;
+
+    switch (frame.data[0] >> 4){
+        case pci_single:{
+            std::size_t len = frame.data[0] & 0xF;
+            if (!len || len + 1 > frame.len) return 1;
+            reset();
+            if (len > pool->buffer_size){
+                std::cerr << "Error (Wreath::CAN::ISOTP): Received " << len << " byte payload, pool buffers hold " << pool->buffer_size << "\n";
+                return 1;
+            }
+            if (!(buffer = pool->acquire())){
+                std::cerr << "Error (Wreath::CAN::ISOTP): Buffer pool exhausted\n";
+                return 1;
+            }
+            std::memcpy(buffer, frame.data + 1, len);
+            out_payload->data = buffer;
+            out_payload->len = len;
+            buffer = nullptr;
+            return 0;
+        }
+        case pci_first:{
+            if (frame.len < CAN_MAX_DLEN) return 1;
+            std::size_t header = 2;
+            std::size_t len = ((frame.data[0] & 0xF) << 8) | frame.data[1];
+            if (!len){
+                header = 6;
+                len = ((std::size_t)frame.data[2] << 24) | ((std::size_t)frame.data[3] << 16) | ((std::size_t)frame.data[4] << 8) | frame.data[5];
+            }
+            //ISO 15765-2 ignores first frames whose length would have fit a single frame (or the 12-bit form)
+            if (len <= (header == 2 ? 7 : max_classic_len)) return 1;
+            reset();
+            if (len > pool->buffer_size || !(buffer = pool->acquire())){
+                make_flow_control(out_flow_control, tx_id, fc_overflow, options);
+                *out_send_flow_control = true;
+                std::cerr << "Error (Wreath::CAN::ISOTP): No pooled buffer for a " << len << " byte payload\n";
+                return 1;
+            }
+            expected = len;
+            received = CAN_MAX_DLEN - header;
+            std::memcpy(buffer, frame.data + header, received);
+            next_seq = 1;
+            block_count = 0;
+            make_flow_control(out_flow_control, tx_id, fc_continue, options);
+            *out_send_flow_control = true;
+            return 2;
+        }
+        case pci_consecutive:{
+            if (!busy()) return 2;
+            if ((frame.data[0] & 0xF) != next_seq){
+                std::cerr << "Error (Wreath::CAN::ISOTP): Expected consecutive frame #" << +next_seq << ", found #" << (frame.data[0] & 0xF) << "\n";
+                reset();
+                return 1;
+            }
+            if (received >= expected){
+                reset();
+                return 1;
+            }
+            std::size_t chunk = std::min<std::size_t>({7, expected - received, (std::size_t)frame.len - 1});
+            std::memcpy(buffer + received, frame.data + 1, chunk);
+            received += chunk;
+            next_seq = (next_seq + 1) & 0xF;
+            if (received == expected){
+                out_payload->data = buffer;
+                out_payload->len = expected;
+                buffer = nullptr;
+                reset();
+                return 0;
+            }
+            if (options.block_size && ++block_count == options.block_size){
+                block_count = 0;
+                make_flow_control(out_flow_control, tx_id, fc_continue, options);
+                *out_send_flow_control = true;
+            }
+            return 2;
+        }
+        case pci_flow_control:
+            return 2;
+    }
+    return 1;
+}
+bool Receiver::busy() const{
+    return buffer != nullptr;
+}
+void Receiver::reset(){
+    if (buffer) pool->release(buffer);
+    buffer = nullptr;
+    expected = 0;
+    received = 0;
+    block_count = 0;
+    next_seq = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int Link::open(const char* interface, canid_t link_tx_id, canid_t link_rx_id, Buffer_Pool* link_pool, const Options& link_options){
+    close();
+    options = link_options;
+    pool = link_pool;
+    tx_id = link_tx_id;
+    rx_id = link_rx_id;
+    receiver = {};
+    receiver.pool = pool;
+    if (!options.force_userspace && !open_kernel(interface)) return 0;
+    return open_userspace(interface);
+}
+int Link::close(){
+    receiver.reset();
+    if (socket < 0) return 0;
+    int res = close_socket(socket);
+    socket = -1;
+    return res;
+}
+int Link::open_kernel(const char* interface){
+    int s = ::socket(PF_CAN, SOCK_DGRAM, CAN_ISOTP);
+    if (s < 0) return 1;
+
+    can_isotp_options isotp_options{};
+    isotp_options.flags = options.use_padding ? CAN_ISOTP_TX_PADDING : 0;
+    isotp_options.txpad_content = options.padding;
+    isotp_options.rxpad_content = options.padding;
+    can_isotp_fc_options fc_options{};
+    fc_options.bs = options.block_size;
+    fc_options.stmin = options.st_min;
+
+    sockaddr_can addr{};
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(interface);
+    addr.can_addr.tp.tx_id = tx_id;
+    addr.can_addr.tp.rx_id = rx_id;
+    if (!addr.can_ifindex ||
+        setsockopt(s, SOL_CAN_ISOTP, CAN_ISOTP_OPTS, &isotp_options, sizeof(isotp_options)) < 0 ||
+        setsockopt(s, SOL_CAN_ISOTP, CAN_ISOTP_RECV_FC, &fc_options, sizeof(fc_options)) < 0 ||
+        bind(s, (sockaddr*)&addr, sizeof(addr)) < 0){
+        close_socket(s);
+        return 1;
+    }
+    socket = s;
+    kernel = true;
+    return 0;
+}
+int Link::open_userspace(const char* interface){
+    int s = create_socket(CAN_RAW);
+    if (s < 0){
+        std::cerr << "Error (Wreath::CAN::ISOTP): Failed to create CAN socket\n";
+        return 1;
+    }
+    can_filter filter;
+    filter.can_id = rx_id;
+    filter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | ((rx_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+    if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter)) < 0 || bind_socket(s, interface) < 0){
+        std::cerr << "Error (Wreath::CAN::ISOTP): Failed to bind CAN socket to '" << interface << "'\n";
+        close_socket(s);
+        return 1;
+    }
+    socket = s;
+    kernel = false;
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int Link::wait_frame(can_frame* out_frame, int timeout_ms){
+    pollfd pfd{socket, POLLIN, 0};
+    int res;
+    while ((res = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR);
+    if (res == 0) return 2;
+    if (res < 0) return 1;
+    return read_bus(socket, out_frame) == sizeof(can_frame) ? 0 : 1;
+}
+int Link::wait_flow_control(__u8* out_block_size, std::uint64_t* out_st_min_ns){
+    can_frame frame;
+    while (true){
+        int res = wait_frame(&frame, options.timeout_ms);
+        if (res == 2) std::cerr << "Error (Wreath::CAN::ISOTP): Timed out waiting for flow control\n";
+        if (res) return 1;
+        if (frame.len < 3 || (frame.data[0] >> 4) != pci_flow_control) continue;
+        switch (frame.data[0] & 0xF){
+            case fc_continue:
+                *out_block_size = frame.data[1];
+                *out_st_min_ns = st_min_to_ns(frame.data[2]);
+                return 0;
+            case fc_wait:
+                continue;
+            case fc_overflow:
+                std::cerr << "Error (Wreath::CAN::ISOTP): Receiver reported buffer overflow\n";
+                return 1;
+        }
+        return 1;
+    }
+}
+int Link::send(const __u8* data, std::size_t len){
+    if (kernel) return write(socket, data, len) == (ssize_t)len ? 0 : 1;
+
+    Sender sender;
+    can_frame batch[max_batch];
+    int res = sender.start(data, len, tx_id, options, &batch[0]);
+    if (res == 1) return 1;
+    if (res == 0) return write_bus_all(socket, batch, 1, options.timeout_ms);
+    if (write_bus_all(socket, batch, 1, options.timeout_ms)) return 1;
+
+    while (!sender.done()){
+        __u8 block_size;
+        std::uint64_t st_min_ns;
+        if (wait_flow_control(&block_size, &st_min_ns)) return 1;
+
+        std::size_t remaining = block_size ? block_size : (std::size_t)-1;
+        while (remaining && !sender.done()){
+            if (st_min_ns){
+                sender.next_consecutive(tx_id, options, &batch[0]);
+                if (write_bus_all(socket, batch, 1, options.timeout_ms)) return 1;
+                timespec delay{(time_t)(st_min_ns / 1000000000), (long)(st_min_ns % 1000000000)};
+                while (nanosleep(&delay, &delay) < 0 && errno == EINTR);
+                remaining--;
+                continue;
+            }
+            std::size_t count = 0;
+            while (count < max_batch && remaining && !sender.done()){
+                sender.next_consecutive(tx_id, options, &batch[count++]);
+                remaining--;
+            }
+            if (write_bus_all(socket, batch, count, options.timeout_ms)) return 1;
+        }
+    }
+    return 0;
+}
+int Link::recv(Payload* out_payload, int timeout_ms){
+    if (kernel){
+        pollfd pfd{socket, POLLIN, 0};
+        int res;
+        while ((res = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR);
+        if (res == 0) return 2;
+        if (res < 0) return 1;
+        __u8* buffer = pool->acquire();
+        if (!buffer){
+            std::cerr << "Error (Wreath::CAN::ISOTP): Buffer pool exhausted\n";
+            return 1;
+        }
+        ssize_t len = ::recv(socket, buffer, pool->buffer_size, MSG_TRUNC);
+        if (len < 0 || (std::size_t)len > pool->buffer_size){
+            if (len > 0) std::cerr << "Error (Wreath::CAN::ISOTP): Received " << len << " byte payload, pool buffers hold " << pool->buffer_size << "\n";
+            pool->release(buffer);
+            return 1;
+        }
+        out_payload->data = buffer;
+        out_payload->len = len;
+        return 0;
+    }
+
+    can_frame frame;
+    can_frame flow_control;
+    bool send_flow_control;
+    while (true){
+        int res = wait_frame(&frame, receiver.busy() ? options.timeout_ms : timeout_ms);
+        if (res == 2 && receiver.busy()){
+            std::cerr << "Error (Wreath::CAN::ISOTP): Timed out waiting for consecutive frame\n";
+            receiver.reset();
+            return 1;
+        }
+        if (res) return res;
+
+        res = receiver.process(frame, tx_id, options, out_payload, &flow_control, &send_flow_control);
+        if (send_flow_control && write_bus_all(socket, &flow_control, 1, options.timeout_ms)){
+            receiver.reset();
+            return 1;
+        }
+        if (res != 2) return res;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+#include "wreath/can/j1939.hpp"
+
+namespace Wreath{
+namespace CAN{
+namespace J1939{
+
+//---------------------------------------------------------------------------------------------------------
+
+static constexpr __u8 cm_rts = 16;
+static constexpr __u8 cm_cts = 17;
+static constexpr __u8 cm_eoma = 19;
+static constexpr __u8 cm_bam = 32;
+static constexpr __u8 cm_abort = 255;
+
+static constexpr __u8 abort_resources = 2;
+static constexpr __u8 abort_timeout = 3;
+static constexpr __u8 abort_bad_sequence = 7;
+
+std::uint32_t pgn_of(canid_t can_id){
+    std::uint32_t pgn = (can_id >> 8) & 0x3FFFF;
+    if (((pgn >> 8) & 0xFF) < 240) pgn &= 0x3FF00;
+    return pgn;
+}
+Id decode_id(canid_t can_id){
+    Id id;
+    id.pgn = pgn_of(can_id);
+    id.priority = (can_id >> 26) & 0x7;
+    id.source_address = can_id & 0xFF;
+    id.destination_address = ((id.pgn >> 8) & 0xFF) < 240 ? (can_id >> 8) & 0xFF : address_global;
+    return id;
+}
+canid_t encode_id(const Id& id){
+    std::uint32_t pgn = id.pgn & 0x3FFFF;
+    if (((pgn >> 8) & 0xFF) < 240) pgn = (pgn & 0x3FF00) | id.destination_address;
+    return CAN_EFF_FLAG | ((canid_t)(id.priority & 0x7) << 26) | (pgn << 8) | id.source_address;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+static std::uint16_t session_key(__u8 source_address, __u8 destination_address){
+    return ((std::uint16_t)source_address << 8) | destination_address;
+}
+static void make_cm(can_frame* frame, __u8 source_address, __u8 destination_address, const __u8 (&data)[5], std::uint32_t pgn){
+    *frame = {};
+    frame->can_id = encode_id({pgn_tp_cm, 7, source_address, destination_address});
+    frame->len = CAN_MAX_DLEN;
+    std::memcpy(frame->data, data, 5);
+    frame->data[5] = pgn & 0xFF;
+    frame->data[6] = (pgn >> 8) & 0xFF;
+    frame->data[7] = (pgn >> 16) & 0xFF;
+}
+
+Transport::~Transport(){
+    for (std::pair<const std::uint16_t, Transfer>& session : sessions) pool->release(session.second.buffer);
+}
+
+void Transport::abort(__u8 source_address, __u8 destination_address){
+    std::unordered_map<std::uint16_t, Transfer>::iterator it = sessions.find(session_key(source_address, destination_address));
+    if (it == sessions.end()) return;
+    pool->release(it->second.buffer);
+    sessions.erase(it);
+}
+
+int Transport::process(const can_frame& frame, std::uint64_t timestamp_ns, Transport_Message* out_message, can_frame* out_response, bool* out_send_response){
+    *out_send_response = false;
+    if (!(frame.can_id & CAN_EFF_FLAG) || frame.len < CAN_MAX_DLEN) return 2;
+    Id id = decode_id(frame.can_id);
+    if (id.pgn != pgn_tp_cm && id.pgn != pgn_tp_dt) return 2;
+    bool respond = id.destination_address == own_address && own_address != address_null;
+
+    if (id.pgn == pgn_tp_cm){
+        __u8 control = frame.data[0];
+        std::uint32_t pgn = frame.data[5] | (frame.data[6] << 8) | (frame.data[7] << 16);
+        if (control == cm_abort){
+            abort(id.source_address, id.destination_address);
+            abort(id.destination_address, id.source_address);
+            return 2;
+        }
+        if (control != cm_rts && control != cm_bam) return 2;
+
+        std::size_t size = frame.data[1] | (frame.data[2] << 8);
+        std::size_t packets = frame.data[3];
+        abort(id.source_address, id.destination_address);
+        if (size < 9 || size > max_transport_size || packets != (size + 6) / 7){
+            std::cerr << "Error (Wreath::CAN::J1939): Malformed transport announcement from address " << +id.source_address << "\n";
+            return 1;
+        }
+        Transfer transfer;
+        if (size > pool->buffer_size || !(transfer.buffer = pool->acquire())){
+            std::cerr << "Error (Wreath::CAN::J1939): No pooled buffer for a " << size << " byte transfer\n";
+            if (respond && control == cm_rts){
+                make_cm(out_response, own_address, id.source_address, {cm_abort, abort_resources, 0xFF, 0xFF, 0xFF}, pgn);
+                *out_send_response = true;
+            }
+            return 1;
+        }
+        transfer.pgn = pgn;
+        transfer.size = size;
+        transfer.packets = packets;
+        transfer.broadcast = control == cm_bam;
+        transfer.max_per_cts = control == cm_rts && frame.data[4] != 0xFF && frame.data[4] ? frame.data[4] : packets;
+        transfer.window_end = packets;
+        transfer.respond = respond && control == cm_rts;
+        transfer.deadline_ns = timestamp_ns + (control == cm_rts ? t2_ns : t1_ns);
+        if (transfer.respond){
+            std::size_t window = std::min<std::size_t>({packets, transfer.max_per_cts, packets_per_cts});
+            transfer.window_end = window;
+            make_cm(out_response, own_address, id.source_address, {cm_cts, (__u8)window, 1, 0xFF, 0xFF}, pgn);
+            *out_send_response = true;
+        }
+        sessions[session_key(id.source_address, id.destination_address)] = transfer;
+        return 2;
+    }
+
+    std::unordered_map<std::uint16_t, Transfer>::iterator it = sessions.find(session_key(id.source_address, id.destination_address));
+    if (it == sessions.end()) return 2;
+    Transfer& transfer = it->second;
+    std::size_t seq = frame.data[0];
+    if (seq != transfer.received + 1){
+        std::cerr << "Error (Wreath::CAN::J1939): Expected transport packet #" << transfer.received + 1 << ", found #" << seq << "\n";
+        if (respond) make_cm(out_response, own_address, id.source_address, {cm_abort, abort_bad_sequence, 0xFF, 0xFF, 0xFF}, transfer.pgn);
+        *out_send_response = respond;
+        abort(id.source_address, id.destination_address);
+        return 1;
+    }
+    std::size_t offset = (seq - 1) * 7;
+    std::memcpy(transfer.buffer + offset, frame.data + 1, std::min<std::size_t>(7, transfer.size - offset));
+    transfer.received = seq;
+    //Passive CMDT sessions cannot see when the real receiver holds the sender with CTS, so they always allow T2
+    bool after_cts = !transfer.broadcast && (!transfer.respond || transfer.received == transfer.window_end);
+    transfer.deadline_ns = timestamp_ns + (after_cts ? t2_ns : t1_ns);
+
+    if (transfer.received == transfer.packets){
+        out_message->id = {transfer.pgn, id.priority, id.source_address, id.destination_address};
+        out_message->data = transfer.buffer;
+        out_message->len = transfer.size;
+        if (respond){
+            make_cm(out_response, own_address, id.source_address, {cm_eoma, (__u8)(transfer.size & 0xFF), (__u8)(transfer.size >> 8), (__u8)transfer.packets, 0xFF}, transfer.pgn);
+            *out_send_response = true;
+        }
+        sessions.erase(it);
+        return 0;
+    }
+    if (respond && transfer.received == transfer.window_end){
+        std::size_t window = std::min<std::size_t>({transfer.packets - transfer.received, transfer.max_per_cts, packets_per_cts});
+        transfer.window_end += window;
+        make_cm(out_response, own_address, id.source_address, {cm_cts, (__u8)window, (__u8)(transfer.received + 1), 0xFF, 0xFF}, transfer.pgn);
+        *out_send_response = true;
+    }
+    return 2;
+}
+std::size_t Transport::expire(std::uint64_t now_ns, std::vector<can_frame>* out_aborts){
+    std::size_t expired = 0;
+    for (std::unordered_map<std::uint16_t, Transfer>::iterator it = sessions.begin(); it != sessions.end();){
+        if (now_ns < it->second.deadline_ns){
+            ++it;
+            continue;
+        }
+        if (it->second.respond && out_aborts){
+            can_frame frame;
+            make_cm(&frame, own_address, it->first >> 8, {cm_abort, abort_timeout, 0xFF, 0xFF, 0xFF}, it->second.pgn);
+            out_aborts->push_back(frame);
+        }
+        pool->release(it->second.buffer);
+        it = sessions.erase(it);
+        expired++;
+    }
+    return expired;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
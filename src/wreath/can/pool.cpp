@@ -0,0 +1,35 @@
+#include "wreath/can/pool.hpp"
+
+namespace Wreath{
+namespace CAN{
+
+//---------------------------------------------------------------------------------------------------------
+
+int Buffer_Pool::init(std::size_t buffer_count, std::size_t size){
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!buffer_count || !size) return 1;
+    std::size_t stride = (size + 7) & ~std::size_t{7};
+    storage.assign(buffer_count * stride, 0);
+    free_list.clear();
+    free_list.reserve(buffer_count);
+    for (std::size_t a = buffer_count; a > 0; a--) free_list.push_back(storage.data() + (a - 1) * stride);
+    buffer_size = size;
+    return 0;
+}
+__u8* Buffer_Pool::acquire(){
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_list.empty()) return nullptr;
+    __u8* buffer = free_list.back();
+    free_list.pop_back();
+    return buffer;
+}
+void Buffer_Pool::release(__u8* buffer){
+    if (!buffer) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    free_list.push_back(buffer);
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
@@ -0,0 +1,309 @@
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "wreath/can/replay.hpp"
+#include "wreath/can/can.hpp"
+
+namespace Wreath{
+namespace CAN{
+namespace Replay{
+
+//---------------------------------------------------------------------------------------------------------
+
+#define CAN_RepError(line, error){std::cerr << "Error (Wreath::CAN::Replay, Line #" << line << "): " << error << "\n"; return 1;}
+
+static const char* skip_spaces(const char* it, const char* end){
+    while (it != end && (*it == ' ' || *it == '\t')) it++;
+    return it;
+}
+static const char* skip_token(const char* it, const char* end){
+    while (it != end && *it != ' ' && *it != '\t') it++;
+    return it;
+}
+static int hex_digit(char c){
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+static const char* parse_hex(const char* it, const char* end, std::uint64_t* out){
+    *out = 0;
+    for (int digit; it != end && (digit = hex_digit(*it)) >= 0; it++) *out = (*out << 4) | digit;
+    return it;
+}
+static const char* parse_dec(const char* it, const char* end, std::uint64_t* out){
+    *out = 0;
+    for (; it != end && *it >= '0' && *it <= '9'; it++) *out = *out * 10 + (*it - '0');
+    return it;
+}
+static const char* parse_timestamp(const char* it, const char* end, std::uint64_t* out_ns){
+    std::uint64_t seconds;
+    const char* beg = it;
+    it = parse_dec(it, end, &seconds);
+    if (it == beg) return beg;
+    *out_ns = seconds * 1000000000;
+    if (it == end || *it != '.') return it;
+    std::uint64_t scale = 100000000;
+    for (it++; it != end && *it >= '0' && *it <= '9'; it++){
+        *out_ns += (*it - '0') * scale;
+        scale /= 10;
+    }
+    return it;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int Log_Reader::open(const char* path){
+    std::size_t path_len = std::strlen(path);
+    bool asc = path_len >= 4 && (std::strcmp(path + path_len - 4, ".asc") == 0 || std::strcmp(path + path_len - 4, ".ASC") == 0);
+    return open(path, asc ? Log_Format::ASC : Log_Format::Candump);
+}
+int Log_Reader::open(const char* path, Log_Format log_format){
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0){
+        std::cerr << "Error (Wreath::CAN::Replay): Failed to open log at path '" << path << "'\n";
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0){
+        ::close(fd);
+        return 1;
+    }
+    void* map = info.st_size ? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (map == MAP_FAILED){
+        std::cerr << "Error (Wreath::CAN::Replay): Failed to map log at path '" << path << "'\n";
+        return 1;
+    }
+    if (map) madvise(map, info.st_size, MADV_SEQUENTIAL);
+
+    close();
+    data = (const char*)map;
+    size = info.st_size;
+    format = log_format;
+    rewind();
+    return 0;
+}
+int Log_Reader::close(){
+    int res = 0;
+    if (data) res = munmap((void*)data, size);
+    data = nullptr;
+    size = 0;
+    cursor = 0;
+    return res;
+}
+void Log_Reader::rewind(){
+    cursor = 0;
+    line_number = 0;
+    hex_ids = true;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+static int parse_candump(const char* it, const char* end, std::size_t line_number, Log_Frame* out_frame){
+    std::uint64_t value;
+    const char* beg;
+
+    if (*it++ != '(') CAN_RepError(line_number, "Expected '(' before timestamp");
+    beg = it;
+    it = parse_timestamp(it, end, &out_frame->timestamp_ns);
+    if (it == beg) CAN_RepError(line_number, "Field 'timestamp' has no length");
+    if (it == end || *it++ != ')') CAN_RepError(line_number, "Expected ')' after timestamp");
+
+    it = skip_spaces(it, end);
+    beg = it;
+    it = skip_token(it, end);
+    if (it == beg) CAN_RepError(line_number, "Field 'interface' has no length");
+    out_frame->channel = std::string_view(beg, it - beg);
+
+    it = skip_spaces(it, end);
+    beg = it;
+    it = parse_hex(it, end, &value);
+    if (it == beg) CAN_RepError(line_number, "Field 'id' has no length");
+    bool extended = it - beg > 3;
+    if (it == end || *it++ != '#') CAN_RepError(line_number, "Expected '#' after id");
+    out_frame->frame = {};
+    out_frame->frame.can_id = (canid_t)value;
+    if (extended && !(value & CAN_ERR_FLAG)) out_frame->frame.can_id |= CAN_EFF_FLAG;
+
+    if (it != end && *it == '#') return 2;
+    if (it != end && (*it == 'R' || *it == 'r')){
+        out_frame->frame.can_id |= CAN_RTR_FLAG;
+        it = parse_dec(it + 1, end, &value);
+        out_frame->frame.len = value > CAN_MAX_DLEN ? CAN_MAX_DLEN : value;
+        return 0;
+    }
+    while (it + 1 < end && hex_digit(it[0]) >= 0 && hex_digit(it[1]) >= 0){
+        if (out_frame->frame.len == CAN_MAX_DLEN) CAN_RepError(line_number, "Payload is longer than 8 bytes");
+        out_frame->frame.data[out_frame->frame.len++] = (hex_digit(it[0]) << 4) | hex_digit(it[1]);
+        it += 2;
+        if (it != end && *it == '.') it++;
+    }
+    return 0;
+}
+static int parse_asc(const char* it, const char* end, std::size_t line_number, bool* hex_ids, Log_Frame* out_frame){
+    std::uint64_t value;
+    const char* beg;
+
+    it = skip_spaces(it, end);
+    if (end - it >= 5 && std::memcmp(it, "base ", 5) == 0){
+        it = skip_spaces(it + 5, end);
+        *hex_ids = end - it < 3 || std::memcmp(it, "dec", 3) != 0;
+        return 2;
+    }
+    beg = it;
+    it = parse_timestamp(it, end, &out_frame->timestamp_ns);
+    if (it == beg || it == end || (*it != ' ' && *it != '\t')) return 2;
+
+    it = skip_spaces(it, end);
+    beg = it;
+    it = parse_dec(it, end, &value);
+    if (it == beg || it == end || (*it != ' ' && *it != '\t')) return 2;
+    out_frame->channel = std::string_view(beg, it - beg);
+
+    it = skip_spaces(it, end);
+    beg = it;
+    it = *hex_ids ? parse_hex(it, end, &value) : parse_dec(it, end, &value);
+    if (it == beg) return 2;
+    out_frame->frame = {};
+    out_frame->frame.can_id = (canid_t)value;
+    if (it != end && *it == 'x'){
+        out_frame->frame.can_id |= CAN_EFF_FLAG;
+        it++;
+    }
+    if (it == end || (*it != ' ' && *it != '\t')) return 2;
+
+    it = skip_spaces(it, end);
+    if (end - it < 2 || (std::memcmp(it, "Rx", 2) != 0 && std::memcmp(it, "Tx", 2) != 0)) return 2;
+    it = skip_spaces(it + 2, end);
+    if (it == end || (*it != 'd' && *it != 'r')) CAN_RepError(line_number, "Expected 'd' or 'r' after direction");
+    bool remote = *it == 'r';
+    it = skip_spaces(it + 1, end);
+
+    beg = it;
+    it = parse_hex(it, end, &value);
+    if (it == beg && !remote) CAN_RepError(line_number, "Field 'dlc' has no length");
+    if (value > CAN_MAX_DLEN) CAN_RepError(line_number, "Payload is longer than 8 bytes");
+    out_frame->frame.len = value;
+    if (remote){
+        out_frame->frame.can_id |= CAN_RTR_FLAG;
+        return 0;
+    }
+    for (std::size_t a = 0; a < out_frame->frame.len; a++){
+        it = skip_spaces(it, end);
+        beg = it;
+        it = parse_hex(it, end, &value);
+        if (it - beg != 2) CAN_RepError(line_number, "Expected " << +out_frame->frame.len << " data bytes");
+        out_frame->frame.data[a] = value;
+    }
+    return 0;
+}
+
+int Log_Reader::next(Log_Frame* out_frame){
+    while (cursor < size){
+        const char* beg = data + cursor;
+        const char* end = (const char*)std::memchr(beg, '\n', size - cursor);
+        if (!end) end = data + size;
+        cursor = end - data + 1;
+        line_number++;
+        if (end != beg && end[-1] == '\r') end--;
+        if (end == beg) continue;
+
+        int res = format == Log_Format::ASC ? parse_asc(beg, end, line_number, &hex_ids, out_frame) : parse_candump(beg, end, line_number, out_frame);
+        if (res != 2) return res;
+    }
+    return 2;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+static std::uint64_t monotonic_ns(){
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (std::uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+static void sleep_until_ns(std::uint64_t deadline){
+    timespec when;
+    when.tv_sec = deadline / 1000000000;
+    when.tv_nsec = deadline % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, nullptr) == EINTR);
+}
+
+int replay(Log_Reader* reader, const std::function<int(const Log_Frame&)>& callback, bool realtime){
+    std::uint64_t first_log = 0;
+    std::uint64_t first_wall = 0;
+    bool started = false;
+    Log_Frame frame;
+    int res;
+
+    while ((res = reader->next(&frame)) != 2){
+        if (res) continue;
+        if (realtime){
+            if (!started){
+                first_log = frame.timestamp_ns;
+                first_wall = monotonic_ns();
+                started = true;
+            }
+            if (frame.timestamp_ns > first_log) sleep_until_ns(first_wall + (frame.timestamp_ns - first_log));
+        }
+        if ((res = callback(frame))) return res;
+    }
+    return 0;
+}
+//Replaying as fast as possible routinely fills the device queue, so wait for it to drain rather than fail
+static int write_frames(int socket, const can_frame* frames, std::size_t count){
+    constexpr int stall_timeout_ms = 1000;
+    if (!write_bus_all(socket, frames, count, stall_timeout_ms)) return 0;
+    std::cerr << "Error (Wreath::CAN::Replay): Failed to write frames: " << std::strerror(errno) << "\n";
+    return 1;
+}
+
+int replay_to_socket(Log_Reader* reader, int socket, bool realtime, std::size_t batch_size){
+    constexpr std::size_t max_batch = 256;
+    can_frame batch[max_batch];
+    std::size_t count = 0;
+    std::uint64_t first_log = 0;
+    std::uint64_t first_wall = 0;
+    bool started = false;
+    Log_Frame frame;
+    int res;
+
+    if (!batch_size) batch_size = 1;
+    if (batch_size > max_batch) batch_size = max_batch;
+    while ((res = reader->next(&frame)) != 2){
+        if (res) continue;
+        if (realtime){
+            if (!started){
+                first_log = frame.timestamp_ns;
+                first_wall = monotonic_ns();
+                started = true;
+            }
+            std::uint64_t due = first_wall + (frame.timestamp_ns > first_log ? frame.timestamp_ns - first_log : 0);
+            if (due > monotonic_ns()){
+                if (count && write_frames(socket, batch, count)) return 1;
+                count = 0;
+                sleep_until_ns(due);
+            }
+        }
+        batch[count++] = frame.frame;
+        if (count == batch_size){
+            if (write_frames(socket, batch, count)) return 1;
+            count = 0;
+        }
+    }
+    if (count && write_frames(socket, batch, count)) return 1;
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
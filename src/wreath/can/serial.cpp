@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <iostream>
+#include <bit>
+
+#include "wreath/dbc/package.hpp"
 #include "wreath/can/serial.hpp"
 
 namespace Wreath{
@@ -5,7 +10,7 @@ namespace CAN{
 namespace Serial{
 
 void direct_deserial(void* dest, const can_frame& src){
-    std::memcpy(dest, src.data, src.len);
+    std::memcpy(dest, src.data, std::min<std::size_t>(src.len, CAN_MAX_DLEN));
 }
 void direct_serial(can_frame* dest, void* src, const DBC::Message& message){
     std::memcpy(dest->data, src, message.length);
@@ -22,6 +27,93 @@ void direct_request_serial(can_frame* dest, void* src, const DBC::Message& messa
     dest->len = 0;
 }
 
+//---------------------------------------------------------------------------------------------------------
+
+static std::uint64_t span_mask(std::size_t offset, std::size_t width){
+    return (width == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << width) - 1) << offset;
+}
+
+//Motorola signals only line up with a memcpy'd struct when they stay inside one byte
+static int signal_span(const DBC::Signal& signal, std::size_t* out_offset, std::size_t* out_width){
+    if (signal.is_little_endian){
+        *out_offset = signal.bit_start;
+        *out_width = signal.bit_length;
+        return 0;
+    }
+    if (!signal.bit_length || signal.bit_length > signal.bit_start % 8 + 1) return 1;
+    *out_offset = signal.bit_start - signal.bit_length + 1;
+    *out_width = signal.bit_length;
+    return 0;
+}
+
+int Overlay::init(const DBC::Message& message, std::size_t struct_size, const std::vector<Overlay_Field>& fields){
+    id = 0;
+    length = 0;
+    if (std::endian::native != std::endian::little){
+        std::cerr << "Error (Wreath::CAN::Serial): Overlays require a little-endian host\n";
+        return 1;
+    }
+    if (message.length > CAN_MAX_DLEN || struct_size != message.length){
+        std::cerr << "Error (Wreath::CAN::Serial): Struct is " << struct_size << " bytes but message '" << message.name << "' is " << message.length << " bytes\n";
+        return 1;
+    }
+
+    std::uint64_t covered = 0;
+    std::vector<bool> described(message.signals.size());
+    for (const Overlay_Field& field : fields){
+        if (!field.bit_width || field.bit_offset + field.bit_width > message.length * 8){
+            std::cerr << "Error (Wreath::CAN::Serial): Field '" << field.name << "' does not fit in message '" << message.name << "'\n";
+            return 1;
+        }
+        std::vector<DBC::Signal>::const_iterator it = std::find_if(message.signals.begin(), message.signals.end(), [&field](const DBC::Signal& signal){return signal.name == field.name;});
+        if (it == message.signals.end()){
+            std::cerr << "Error (Wreath::CAN::Serial): Message '" << message.name << "' has no signal '" << field.name << "'\n";
+            return 1;
+        }
+        std::size_t offset, width;
+        if (signal_span(*it, &offset, &width)){
+            std::cerr << "Error (Wreath::CAN::Serial): Signal '" << it->name << "' is big-endian across bytes and cannot be overlaid\n";
+            return 1;
+        }
+        if (offset != field.bit_offset || width != field.bit_width){
+            std::cerr << "Error (Wreath::CAN::Serial): Field '" << field.name << "' is bits " << field.bit_offset << "+" << field.bit_width << " but the DBC has bits " << offset << "+" << width << "\n";
+            return 1;
+        }
+        std::uint64_t mask = span_mask(field.bit_offset, field.bit_width);
+        if (covered & mask){
+            std::cerr << "Error (Wreath::CAN::Serial): Field '" << field.name << "' overlaps another field\n";
+            return 1;
+        }
+        covered |= mask;
+        described[it - message.signals.begin()] = true;
+    }
+
+    //A signal the struct does not describe must not land inside a field, or reading that field would mix in its bits
+    for (std::size_t a = 0; a < message.signals.size(); a++){
+        if (!described[a] && covered & DBC::Package::signal_mask(message.signals[a])){
+            std::cerr << "Error (Wreath::CAN::Serial): Signal '" << message.signals[a].name << "' overlaps a field but is not described by it\n";
+            return 1;
+        }
+    }
+
+    id = message.id;
+    length = message.length;
+    return 0;
+}
+
+int Overlay::deserial(void* dest, const can_frame& src) const{
+    if (!length || (src.can_id & (CAN_EFF_FLAG | CAN_EFF_MASK)) != id || src.can_id & CAN_RTR_FLAG || src.len < length) return 1;
+    std::memcpy(dest, src.data, length);
+    return 0;
+}
+int Overlay::serial(can_frame* dest, const void* src) const{
+    if (!length) return 1;
+    std::memcpy(dest->data, src, length);
+    dest->len = length;
+    dest->can_id = id;
+    return 0;
+}
+
 }
 }
 }
@@ -2,9 +2,16 @@
 #include <iostream>
 #include <fstream>
 #include <limits>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "wreath/dbc/database.hpp"
 #include "wreath/dbc/parser.hpp"
+#include "wreath/can/j1939.hpp"
 
 namespace Wreath{
 namespace DBC{
@@ -41,12 +48,22 @@ int Message::get_signal_bname(const std::string& name, Signal** out_signal){
 
 //---------------------------------------------------------------------------------------------------------
 
+static void apply_val_type(Signal* signal, const Val_Type_Decl& decl){
+    signal->is_single_float = decl.value_type == 1;
+    signal->is_double_float = decl.value_type == 2;
+}
+static void apply_attribute(Message* message, const Attr_Decl& decl){
+    if (decl.attribute_name == "GenMsgCycleTime") message->cycle_time = std::strtoull(decl.value.c_str(), nullptr, 10);
+}
+
 int Database::from_file(std::ifstream& dbc_file){
     std::size_t last_message_id = std::numeric_limits<std::size_t>::max();
     Message* message_ref;
     Signal* signal_ref;
     Message message;
     Signal signal;
+    Val_Type_Decl val_type;
+    Attr_Decl attr;
     Val_Decl val;
     int res = 0;
 
@@ -77,6 +94,21 @@ int Database::from_file(std::ifstream& dbc_file){
             goto next_line;
         } else if (res != 2) return res;
 
+        val_type = {};
+        if (!(res = Parser::parse_sig_valtype(line, line_number, &val_type))){
+            if (get_message_bid(val_type.object_id, &message_ref)) DBC_ParError_Other("SIG_VALTYPE_", line_number, "SIG_VALTYPE_ line references BO_ that has not been defined");
+            if (message_ref->get_signal_bname(val_type.signal_name, &signal_ref)) DBC_ParError_Other("SIG_VALTYPE_", line_number, "SIG_VALTYPE_ line references SG_ that has not been defined");
+            apply_val_type(signal_ref, val_type);
+            goto next_line;
+        } else if (res != 2) return res;
+
+        attr = {};
+        if (!(res = Parser::parse_ba_bo(line, line_number, &attr))){
+            if (get_message_bid(attr.object_id, &message_ref)) DBC_ParError_Other("BA_", line_number, "BA_ line references BO_ that has not been defined");
+            apply_attribute(message_ref, attr);
+            goto next_line;
+        } else if (res != 2) return res;
+
         next_line:
         line_number++;
     }
@@ -84,14 +116,237 @@ int Database::from_file(std::ifstream& dbc_file){
     return 0;
 }
 
+//---------------------------------------------------------------------------------------------------------
+
+Lazy_Mapping::~Lazy_Mapping(){
+    if (data) munmap((void*)data, size);
+}
+
+Database::Database(const Database& other){
+    *this = other;
+}
+Database& Database::operator=(const Database& other){
+    if (this == &other) return *this;
+    nodes = other.nodes;
+    version = other.version;
+    pgn_index = other.pgn_index;
+    j1939_mode = other.j1939_mode;
+    if (!other.lazy){
+        objects = other.objects;
+        lazy.reset();
+        return *this;
+    }
+
+    //Each message is copied under its entry's lock so a concurrent first lookup on 'other' is
+    //either fully visible in the copy (and marked loaded) or not started
+    std::unique_ptr<Lazy_Index> index = std::make_unique<Lazy_Index>();
+    index->mapping = other.lazy->mapping;
+    std::vector<Message> copied;
+    copied.reserve(other.objects.size());
+    for (const Message& message : other.objects){
+        std::unordered_map<std::size_t, Lazy_Entry*>::const_iterator it = other.lazy->by_id.find(message.id);
+        if (it == other.lazy->by_id.end()){
+            copied.push_back(message);
+            continue;
+        }
+        Lazy_Entry& source = *it->second;
+        Lazy_Entry& entry = index->entries.emplace_back();
+        entry.decl_lines = source.decl_lines;
+        entry.body_begin = source.body_begin;
+        entry.body_end = source.body_end;
+        entry.line_number = source.line_number;
+        {
+            std::lock_guard<std::mutex> lock(source.mutex);
+            copied.push_back(message);
+            entry.result = source.result;
+            entry.loaded.store(source.loaded.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        index->by_id[message.id] = &entry;
+    }
+    objects = std::move(copied);
+    lazy = std::move(index);
+    return *this;
+}
+
+static std::string_view first_token(const char* beg, const char* end){
+    while (beg != end && (*beg == ' ' || *beg == '\t')) beg++;
+    const char* it = beg;
+    while (it != end && *it != ' ' && *it != '\t' && *it != '\r') it++;
+    return std::string_view(beg, it - beg);
+}
+static std::size_t declared_object_id(const char* beg, const char* end){
+    std::string_view token = first_token(beg, end);
+    const char* it = token.data() + token.size();
+    while (it != end && (*it == ' ' || *it == '\t')) it++;
+    std::size_t id = 0;
+    const char* digits = it;
+    for (; it != end && *it >= '0' && *it <= '9'; it++) id = id * 10 + (*it - '0');
+    return it == digits ? std::numeric_limits<std::size_t>::max() : id;
+}
+
+int Database::from_file_lazy(const char* path){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        std::cerr << "Error (Wreath::DBC::Parse): Failed to open file at path '" << path << "'\n";
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0){
+        close(fd);
+        return 1;
+    }
+    void* map = info.st_size ? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (map == MAP_FAILED){
+        std::cerr << "Error (Wreath::DBC::Parse): Failed to map file at path '" << path << "'\n";
+        return 1;
+    }
+
+    std::shared_ptr<Lazy_Mapping> mapping = std::make_shared<Lazy_Mapping>();
+    mapping->data = (const char*)map;
+    mapping->size = info.st_size;
+    std::unique_ptr<Lazy_Index> index = std::make_unique<Lazy_Index>();
+    index->mapping = mapping;
+
+    Lazy_Entry* entry = nullptr;
+    Message message;
+    std::string line;
+    std::size_t line_number = 1;
+    int res = 0;
+    for (std::size_t cursor = 0; cursor < mapping->size; line_number++){
+        const char* beg = mapping->data + cursor;
+        const char* end = (const char*)std::memchr(beg, '\n', mapping->size - cursor);
+        if (!end) end = mapping->data + mapping->size;
+        std::size_t line_begin = cursor;
+        cursor = end - mapping->data + 1;
+
+        std::string_view token = first_token(beg, end);
+        if (entry && token != "SG_"){
+            entry->body_end = line_begin;
+            entry = nullptr;
+        }
+        if (token == "BO_"){
+            line.assign(beg, end);
+            message = {};
+            if ((res = Parser::parse_bo(line, line_number, &message))) return res;
+            add_message(message);
+            entry = &index->entries.emplace_back();
+            entry->body_begin = cursor;
+            entry->body_end = cursor;
+            entry->line_number = line_number + 1;
+            entry->result = 0;
+            index->by_id[message.id] = entry;
+        } else if (token == "SG_" && !entry){
+            DBC_ParError_Other("SG_", line_number, "SG_ line does not follow a BO_ line");
+        } else if (token == "BA_"){
+            Attr_Decl attr;
+            Message* message_ref;
+            line.assign(beg, end);
+            if ((res = Parser::parse_ba_bo(line, line_number, &attr)) == 2) continue;
+            if (res) return res;
+            if (get_message_bid(attr.object_id, &message_ref)) DBC_ParError_Other("BA_", line_number, "BA_ line references BO_ that has not been defined");
+            apply_attribute(message_ref, attr);
+        } else if (token == "VAL_" || token == "SIG_VALTYPE_"){
+            std::size_t object_id = declared_object_id(beg, end);
+            if (object_id == std::numeric_limits<std::size_t>::max()) continue;
+            std::unordered_map<std::size_t, Lazy_Entry*>::iterator it = index->by_id.find(object_id);
+            if (it == index->by_id.end()) DBC_ParError_Other(token, line_number, token << " line references BO_ that has not been defined");
+            it->second->decl_lines.push_back({line_begin, line_number});
+        }
+    }
+    if (entry) entry->body_end = mapping->size;
+
+    lazy = std::move(index);
+    return 0;
+}
+static void load_entry(const Lazy_Mapping& mapping, Lazy_Entry* entry, Message* message_ref){
+    const char* data = mapping.data;
+    std::size_t line_number = entry->line_number;
+    std::string line;
+    Signal signal;
+    Signal* signal_ref;
+    Val_Type_Decl val_type;
+    Val_Decl val;
+
+    entry->result = 0;
+    for (std::size_t cursor = entry->body_begin; cursor < entry->body_end; line_number++){
+        const char* beg = data + cursor;
+        const char* end = (const char*)std::memchr(beg, '\n', entry->body_end - cursor);
+        if (!end) end = data + entry->body_end;
+        cursor = end - data + 1;
+
+        line.assign(beg, end);
+        signal = {};
+        if ((entry->result = Parser::parse_sg(line, line_number, &signal))) return;
+        message_ref->add_signal(signal);
+    }
+    for (const std::pair<std::size_t, std::size_t>& decl : entry->decl_lines){
+        const char* beg = data + decl.first;
+        const char* end = (const char*)std::memchr(beg, '\n', mapping.size - decl.first);
+        if (!end) end = data + mapping.size;
+
+        line.assign(beg, end);
+        val = {};
+        if (!(entry->result = Parser::parse_val(line, decl.second, &val))){
+            if (message_ref->get_signal_bname(val.signal_name, &signal_ref)){
+                std::cerr << "Error (Wreath::DBC::Parse, VAL_, Line #" << decl.second << "): VAL_ line references SG_ that has not been defined\n";
+                entry->result = 1;
+                return;
+            }
+            signal_ref->set_value_enum(val.value_enum);
+            continue;
+        } else if (entry->result != 2) return;
+
+        val_type = {};
+        if (!(entry->result = Parser::parse_sig_valtype(line, decl.second, &val_type))){
+            if (message_ref->get_signal_bname(val_type.signal_name, &signal_ref)){
+                std::cerr << "Error (Wreath::DBC::Parse, SIG_VALTYPE_, Line #" << decl.second << "): SIG_VALTYPE_ line references SG_ that has not been defined\n";
+                entry->result = 1;
+                return;
+            }
+            apply_val_type(signal_ref, val_type);
+        } else return;
+    }
+}
+int Database::load_all() const{
+    for (const Message& message : objects) if (load_message(message)) return 1;
+    return 0;
+}
+int Database::load_message(const Message& message) const{
+    if (!lazy) return 0;
+    std::unordered_map<std::size_t, Lazy_Entry*>::iterator it = lazy->by_id.find(message.id);
+    if (it == lazy->by_id.end()) return 0;
+    Lazy_Entry* entry = it->second;
+
+    //Loading fills in a message that is already visible through 'objects', so it is logically const
+    if (entry->loaded.load(std::memory_order_acquire)) return entry->result;
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (entry->loaded.load(std::memory_order_relaxed)) return entry->result;
+    load_entry(*lazy->mapping, entry, const_cast<Message*>(&message));
+    entry->loaded.store(true, std::memory_order_release);
+    return entry->result;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
 void Database::add_message(const Message& object){
     std::vector<Message>::const_iterator it = std::upper_bound(objects.begin(), objects.end(), object, [](const Message& lhs, const Message& rhs){return lhs.id < rhs.id;});
-    objects.insert(it, object);
+    std::vector<Message>::iterator inserted = objects.insert(it, object);
+    std::size_t position = inserted - objects.begin();
+    if (!j1939_mode) return;
+    //Messages usually arrive in ID order, so positions only need shifting for an insert in the middle
+    if (position + 1 < objects.size()){
+        for (std::pair<const std::uint32_t, std::vector<std::size_t>>& entry : pgn_index){
+            for (std::size_t& other : entry.second) if (other >= position) other++;
+        }
+    }
+    index_j1939_message(position);
 }
 int Database::get_message_bid(std::size_t id, Message* out_message) const{
     std::vector<Message>::const_iterator it = std::lower_bound(objects.begin(), objects.end(), Message{}, [&id](const Message& lhs, const Message&){return lhs.id < id;});
     if (it == objects.end()) return 1;
     if (it->id != id) return 1;
+    if (load_message(*it)) return 1;
     *out_message = *it;
     return 0;
 }
@@ -99,23 +354,81 @@ int Database::get_message_bid(std::size_t id, Message** out_message){
     std::vector<Message>::iterator it = std::lower_bound(objects.begin(), objects.end(), Message{}, [&id](const Message& lhs, const Message&){return lhs.id < id;});
     if (it == objects.end()) return 1;
     if (it->id != id) return 1;
+    if (load_message(*it)) return 1;
     *out_message = &*it;
     return 0;
 }
 int Database::get_message_bname(std::string name, Message* out_message) const{
     std::vector<Message>::const_iterator it = std::find_if(objects.begin(), objects.end(), [&name](const Message& lhs){return lhs.name == name;});
     if (it == objects.end()) return 1;
+    if (load_message(*it)) return 1;
     *out_message = *it;
     return 0;
 }
 int Database::get_message_bname(std::string name, Message** out_message){
     std::vector<Message>::iterator it = std::find_if(objects.begin(), objects.end(), [&name](const Message& lhs){return lhs.name == name;});
     if (it == objects.end()) return 1;
+    if (load_message(*it)) return 1;
     *out_message = &*it;
     return 0;
 }
 
 //---------------------------------------------------------------------------------------------------------
 
+int Database::build_j1939_index(){
+    j1939_mode = true;
+    pgn_index.clear();
+    pgn_index.reserve(objects.size());
+    for (std::size_t a = 0; a < objects.size(); a++) index_j1939_message(a);
+    return 0;
+}
+//'objects' is sorted by ID, so keeping positions sorted keeps the lowest ID first
+void Database::index_j1939_message(std::size_t position){
+    if (!(objects[position].id & CAN_EFF_FLAG)) return;
+    std::vector<std::size_t>& positions = pgn_index[CAN::J1939::pgn_of(objects[position].id & CAN_EFF_MASK)];
+    positions.insert(std::upper_bound(positions.begin(), positions.end(), position), position);
+}
+//Returns objects.size() if the PGN is unknown. A PGN rarely has more than a handful of source ECUs
+static std::size_t find_j1939(const Database& database, std::uint32_t pgn, std::size_t can_id){
+    std::unordered_map<std::uint32_t, std::vector<std::size_t>>::const_iterator it = database.pgn_index.find(pgn);
+    if (it == database.pgn_index.end()) return database.objects.size();
+    for (std::size_t position : it->second) if (database.objects[position].id == can_id) return position;
+    return it->second.front();
+}
+int Database::get_message_bpgn(std::uint32_t pgn, Message* out_message) const{
+    std::size_t position = find_j1939(*this, pgn, 0);
+    if (position == objects.size()) return 1;
+    if (load_message(objects[position])) return 1;
+    *out_message = objects[position];
+    return 0;
+}
+int Database::get_message_bpgn(std::uint32_t pgn, Message** out_message){
+    std::size_t position = find_j1939(*this, pgn, 0);
+    if (position == objects.size()) return 1;
+    if (load_message(objects[position])) return 1;
+    *out_message = &objects[position];
+    return 0;
+}
+int Database::get_message_bj1939(std::size_t can_id, Message* out_message, CAN::J1939::Id* out_id) const{
+    if (!(can_id & CAN_EFF_FLAG)) return 1;
+    *out_id = CAN::J1939::decode_id(can_id & CAN_EFF_MASK);
+    std::size_t position = find_j1939(*this, out_id->pgn, can_id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+    if (position == objects.size()) return 1;
+    if (load_message(objects[position])) return 1;
+    *out_message = objects[position];
+    return 0;
+}
+int Database::get_message_bj1939(std::size_t can_id, Message** out_message, CAN::J1939::Id* out_id){
+    if (!(can_id & CAN_EFF_FLAG)) return 1;
+    *out_id = CAN::J1939::decode_id(can_id & CAN_EFF_MASK);
+    std::size_t position = find_j1939(*this, out_id->pgn, can_id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+    if (position == objects.size()) return 1;
+    if (load_message(objects[position])) return 1;
+    *out_message = &objects[position];
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
 }
 }
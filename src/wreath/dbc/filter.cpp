@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+#include "wreath/dbc/package.hpp"
+#include "wreath/dbc/filter.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Filter{
+
+//---------------------------------------------------------------------------------------------------------
+
+int Delta_Filter::init(const Database& database){
+    if (database.load_all()) return 1;
+    states.clear();
+    states.reserve(database.objects.size());
+    for (const Message& message : database.objects){
+        Delta_State state{};
+        state.message = &message;
+        state.signals.reserve(message.signals.size());
+        for (const Signal& signal : message.signals){
+            std::uint64_t mask = Package::signal_mask(signal);
+            if (!mask){
+                std::cerr << "Error (Wreath::DBC::Filter): Signal '" << signal.name << "' in message '" << message.name << "' does not fit in a classic CAN payload\n";
+                return 1;
+            }
+            state.signals.push_back({mask, 0.0, 0.0});
+        }
+        states.emplace((canid_t)message.id, std::move(state));
+    }
+    return 0;
+}
+int Delta_Filter::set_deadband(std::size_t id, const std::string& signal_name, double deadband){
+    std::unordered_map<canid_t, Delta_State>::iterator it = states.find((canid_t)id);
+    if (it == states.end()) return 1;
+    const std::vector<Signal>& signals = it->second.message->signals;
+    std::vector<Signal>::const_iterator sit = std::find_if(signals.begin(), signals.end(), [&signal_name](const Signal& signal){return signal.name == signal_name;});
+    if (sit == signals.end()) return 1;
+    it->second.signals[sit - signals.begin()].deadband = std::fabs(deadband);
+    return 0;
+}
+void Delta_Filter::reset(){
+    for (std::pair<const canid_t, Delta_State>& state : states) state.second.has_payload = false;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int Delta_Filter::filter_frame(const can_frame* frame, std::vector<std::size_t>* out_changed){
+    out_changed->clear();
+    //Remote requests carry no signals; letting them update last_len would force a full report on the next data frame
+    if (frame->can_id & CAN_RTR_FLAG) return 2;
+    std::unordered_map<canid_t, Delta_State>::iterator it = states.find(frame->can_id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+    if (it == states.end()) return 1;
+    Delta_State& state = it->second;
+
+    std::uint64_t payload = Package::load_payload(frame);
+    bool full = !state.has_payload || state.last_len != frame->len;
+    std::uint64_t diff = payload ^ state.last_payload;
+    if (!full && !diff) return 2;
+
+    for (std::size_t a = 0; a < state.signals.size(); a++){
+        Delta_Signal& signal = state.signals[a];
+        if (!full && !(diff & signal.mask)) continue;
+        if (signal.deadband > 0.0){
+            double value = Package::raw_to_physical(state.message->signals[a], Package::extract_raw(state.message->signals[a], payload));
+            if (!full && std::fabs(value - signal.last_value) < signal.deadband) continue;
+            signal.last_value = value;
+        }
+        out_changed->push_back(a);
+    }
+
+    state.last_payload = payload;
+    state.last_len = frame->len;
+    state.has_payload = true;
+    return out_changed->empty() ? 2 : 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <iostream>
 #include <cstdarg>
 #include <cstdint>
 #include <cstring>
 #include <climits>
+#include <bit>
 
+#include "wreath/metrics/metrics.hpp"
 #include "wreath/dbc/package.hpp"
 
 namespace Wreath{
@@ -73,14 +76,52 @@ void reverse_memcpy_bits(__u8* dest, const __u8* src, std::size_t sbyte, std::si
 
 //---------------------------------------------------------------------------------------------------------
 
-int package_dbc_message(const Message& message, int can_flags, can_frame* out_frame, ...){
+std::uint64_t load_payload(const can_frame* frame){
+    std::uint64_t payload = 0;
+    std::memcpy(&payload, frame->data, std::min<std::size_t>(frame->len, CAN_MAX_DLEN));
+    if (std::endian::native == std::endian::big) payload = std::byteswap(payload);
+    return payload;
+}
+std::uint64_t signal_mask(const Signal& signal){
+    if (!signal.bit_length || signal.bit_length > 64) return 0;
+    std::uint64_t mask = signal.bit_length == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << signal.bit_length) - 1;
+    if (signal.is_little_endian){
+        if (signal.bit_start + signal.bit_length > 64) return 0;
+        return mask << signal.bit_start;
+    }
+    //Motorola signals start at their MSB and walk down the sawtooth bit order,
+    //which is contiguous once the payload is viewed as a big-endian word
+    std::size_t msb = (7 - signal.bit_start / 8) * 8 + signal.bit_start % 8;
+    if (msb + 1 < signal.bit_length) return 0;
+    return std::byteswap(mask << (msb + 1 - signal.bit_length));
+}
+std::uint64_t extract_raw(const Signal& signal, std::uint64_t payload){
+    if (!signal.bit_length || signal.bit_length > 64) return 0;
+    std::uint64_t mask = signal.bit_length == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << signal.bit_length) - 1;
+    if (signal.is_little_endian) return (payload >> signal.bit_start) & mask;
+    std::size_t msb = (7 - signal.bit_start / 8) * 8 + signal.bit_start % 8;
+    if (msb + 1 < signal.bit_length) return 0;
+    return (std::byteswap(payload) >> (msb + 1 - signal.bit_length)) & mask;
+}
+double raw_to_physical(const Signal& signal, std::uint64_t raw){
+    double val;
+    if (signal.is_single_float) val = std::bit_cast<float>((std::uint32_t)raw);
+    else if (signal.is_double_float) val = std::bit_cast<double>(raw);
+    else if (signal.is_signed && signal.bit_length && signal.bit_length < 64 && (raw >> (signal.bit_length - 1)) & 1){
+        val = (double)(std::int64_t)(raw | (~std::uint64_t{0} << signal.bit_length));
+    } else if (signal.is_signed) val = (double)(std::int64_t)raw;
+    else val = (double)raw;
+    return val * signal.factor + signal.offset;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+static int package_dbc_message_args(const Message& message, int can_flags, can_frame* out_frame, va_list args){
     if (std::endian::native != std::endian::little && std::endian::native != std::endian::big){
         std::cerr << "Warning (Package_CAN_Message): Cannot determine endianness. Package may be malformed\n";
     }
     out_frame->can_id = message.id | can_flags;
     out_frame->len = message.length;
-    va_list args;
-    va_start(args, out_frame);
     for (std::size_t a = 0; a < message.signals.size(); a++){
         if (message.signals[a].is_single_float){
             if (sizeof(float) != 4 || CHAR_BIT != 8){
@@ -125,12 +166,10 @@ int package_dbc_message(const Message& message, int can_flags, can_frame* out_fr
     }
     return 0;
 }
-int unpackage_dbc_message(const Message& message, const can_frame* frame, ...){
+static int unpackage_dbc_message_args(const Message& message, const can_frame* frame, va_list args){
     if (std::endian::native != std::endian::little && std::endian::native != std::endian::big){
         std::cerr << "Warning (Unpackage_CAN_Message): Cannot determine endianness. Package may be malformed\n";
     }
-    va_list args;
-    va_start(args, frame);
     for (std::size_t a = 0; a < message.signals.size(); a++){
         if (message.signals[a].is_single_float){
             if (sizeof(float) != 4 || CHAR_BIT != 8){
@@ -141,7 +180,7 @@ int unpackage_dbc_message(const Message& message, const can_frame* frame, ...){
             std::size_t sbyte = message.signals[a].bit_start / 8;
             std::size_t sbit = message.signals[a].bit_start % 8;
             std::size_t blen = message.signals[a].bit_length;
-            reverse_memcpy_bits((__u8*)&val, frame->data, sbyte, sbit, blen);
+            reverse_memcpy_bits((__u8*)val, frame->data, sbyte, sbit, blen);
         } else if (message.signals[a].is_double_float){
             if (sizeof(double) != 8 || CHAR_BIT != 8){
                 std::cerr << "Error (Unpackage_CAN_Message): Failed to unpackage CAN message. 'double' is not IEEE-754 64-bit float\n";
@@ -151,13 +190,13 @@ int unpackage_dbc_message(const Message& message, const can_frame* frame, ...){
             std::size_t sbyte = message.signals[a].bit_start / 8;
             std::size_t sbit = message.signals[a].bit_start % 8;
             std::size_t blen = message.signals[a].bit_length;
-            reverse_memcpy_bits((__u8*)&val, frame->data, sbyte, sbit, blen);
+            reverse_memcpy_bits((__u8*)val, frame->data, sbyte, sbit, blen);
         } else if (message.signals[a].is_signed){
             std::intmax_t* val = va_arg(args, std::intmax_t*);
             std::size_t sbyte = message.signals[a].bit_start / 8;
             std::size_t sbit = message.signals[a].bit_start % 8;
             std::size_t blen = message.signals[a].bit_length;
-            reverse_memcpy_bits((__u8*)&val, frame->data, sbyte, sbit, blen);
+            reverse_memcpy_bits((__u8*)val, frame->data, sbyte, sbit, blen);
             if (message.signals[a].is_little_endian && std::endian::native == std::endian::big || !message.signals[a].is_little_endian && std::endian::native == std::endian::little){
                 *val = std::byteswap(*val);
             }
@@ -166,7 +205,7 @@ int unpackage_dbc_message(const Message& message, const can_frame* frame, ...){
             std::size_t sbyte = message.signals[a].bit_start / 8;
             std::size_t sbit = message.signals[a].bit_start % 8;
             std::size_t blen = message.signals[a].bit_length;
-            reverse_memcpy_bits((__u8*)&val, frame->data, sbyte, sbit, blen);
+            reverse_memcpy_bits((__u8*)val, frame->data, sbyte, sbit, blen);
             if (message.signals[a].is_little_endian && std::endian::native == std::endian::big || !message.signals[a].is_little_endian && std::endian::native == std::endian::little){
                 *val = std::byteswap(*val);
             }
@@ -175,6 +214,35 @@ int unpackage_dbc_message(const Message& message, const can_frame* frame, ...){
     return 0;
 }
 
+int package_dbc_message(const Message& message, int can_flags, can_frame* out_frame, ...){
+    va_list args;
+    va_start(args, out_frame);
+    if (!Metrics::is_enabled()){
+        int res = package_dbc_message_args(message, can_flags, out_frame, args);
+        va_end(args);
+        return res;
+    }
+    std::uint64_t start = Metrics::now_ns();
+    int res = package_dbc_message_args(message, can_flags, out_frame, args);
+    Metrics::record_encode(Metrics::now_ns() - start);
+    va_end(args);
+    return res;
+}
+int unpackage_dbc_message(const Message& message, const can_frame* frame, ...){
+    va_list args;
+    va_start(args, frame);
+    if (!Metrics::is_enabled()){
+        int res = unpackage_dbc_message_args(message, frame, args);
+        va_end(args);
+        return res;
+    }
+    std::uint64_t start = Metrics::now_ns();
+    int res = unpackage_dbc_message_args(message, frame, args);
+    Metrics::record_decode(Metrics::now_ns() - start);
+    va_end(args);
+    return res;
+}
+
 //---------------------------------------------------------------------------------------------------------
 
 }
@@ -183,6 +183,69 @@ int parse_val(const std::string_view& line, std::size_t line_number, Val_Decl* o
 
     return 0;
 }
+int parse_sig_valtype(const std::string_view& line, std::size_t line_number, Val_Type_Decl* output){
+    std::string_view::const_iterator it1, it2, it3;
+
+    it1 = absorb_spaces(line.begin(), line.end());
+    it2 = absorb_non_spaces(it1, line.end());
+    if (it1 == it2) return 2;
+    if (std::string(it1, it2) != "SIG_VALTYPE_") return 2;
+    if (*(it1 = it2) != ' ') return 2;
+
+    it1 = absorb_spaces(it1, line.end());
+    it2 = absorb_unsigned(it1, line.end());
+    if (it1 == it2) DBC_ParError_Null("SIG_VALTYPE_", line_number, "object_id");
+    output->object_id = std::stoull(std::string(it1, it2));
+
+    it1 = absorb_spaces(it2, line.end());
+    it2 = absorb_until(it1, line.end(), ':');
+    it3 = absorb_non_spaces(it1, line.end());
+    if (*it2 != ':') DBC_ParError_Unex("SIG_VALTYPE_", line_number, ":", *it2);
+    if (it1 == std::min(it2, it3)) DBC_ParError_Null("SIG_VALTYPE_", line_number, "signal_name");
+    output->signal_name = std::string(it1, std::min(it2, it3));
+
+    it1 = absorb_spaces(it2+1, line.end());
+    it2 = absorb_unsigned(it1, line.end());
+    if (it1 == it2) DBC_ParError_Null("SIG_VALTYPE_", line_number, "value_type");
+    output->value_type = std::stoull(std::string(it1, it2));
+    if (output->value_type > 2) DBC_ParError_Other("SIG_VALTYPE_", line_number, "Value type must be 0, 1 or 2");
+
+    return 0;
+}
+int parse_ba_bo(const std::string_view& line, std::size_t line_number, Attr_Decl* output){
+    std::string_view::const_iterator it1, it2;
+
+    it1 = absorb_spaces(line.begin(), line.end());
+    it2 = absorb_non_spaces(it1, line.end());
+    if (it1 == it2) return 2;
+    if (std::string(it1, it2) != "BA_") return 2;
+    if (*(it1 = it2) != ' ') return 2;
+
+    it1 = absorb_spaces(it1, line.end());
+    if (*it1 != '\"') DBC_ParError_Unex("BA_", line_number, "\"", *it1);
+    it2 = absorb_until(++it1, line.end(), '\"');
+    if (*it2 != '\"') DBC_ParError_Unex("BA_", line_number, "\"", *it2);
+    if (it1 == it2) DBC_ParError_Null("BA_", line_number, "attribute_name");
+    output->attribute_name = std::string(it1, it2);
+
+    it1 = absorb_spaces(++it2, line.end());
+    it2 = absorb_non_spaces(it1, line.end());
+    if (std::string(it1, it2) != "BO_") return 2;
+
+    it1 = absorb_spaces(it2, line.end());
+    it2 = absorb_unsigned(it1, line.end());
+    if (it1 == it2) DBC_ParError_Null("BA_", line_number, "object_id");
+    output->object_id = std::stoull(std::string(it1, it2));
+
+    it1 = absorb_spaces(it2, line.end());
+    it2 = absorb_until(it1, line.end(), ';');
+    if (*it2 != ';') DBC_ParError_Unex("BA_", line_number, ";", *it2);
+    while (it2 != it1 && std::isspace(*(it2 - 1))) it2--;
+    if (it1 == it2) DBC_ParError_Null("BA_", line_number, "value");
+    output->value = std::string(it1, it2);
+
+    return 0;
+}
 
 //---------------------------------------------------------------------------------------------------------
 
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <bit>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "wreath/dbc/package.hpp"
+#include "wreath/dbc/recorder.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Recorder{
+
+//---------------------------------------------------------------------------------------------------------
+
+static constexpr char file_magic[8] = {'W', 'R', 'D', 'B', 'C', 'R', 'E', 'C'};
+static constexpr std::uint32_t file_version = 1;
+static constexpr std::uint32_t block_magic = 0x4B4C4257;
+static constexpr std::size_t staging_size = 1 << 20;
+static constexpr std::size_t direct_io_align = 4096;
+
+static constexpr __u8 flag_signed = 1;
+static constexpr __u8 flag_single_float = 2;
+static constexpr __u8 flag_double_float = 4;
+
+static std::uint64_t zigzag(std::int64_t val){
+    return ((std::uint64_t)val << 1) ^ (std::uint64_t)(val >> 63);
+}
+static std::int64_t unzigzag(std::uint64_t val){
+    return (std::int64_t)(val >> 1) ^ -(std::int64_t)(val & 1);
+}
+static void put_varint(std::vector<__u8>* out, std::uint64_t val){
+    while (val >= 0x80){
+        out->push_back((__u8)val | 0x80);
+        val >>= 7;
+    }
+    out->push_back((__u8)val);
+}
+static const __u8* get_varint(const __u8* it, const __u8* end, std::uint64_t* out){
+    *out = 0;
+    for (std::size_t shift = 0; it != end && shift < 64; shift += 7){
+        __u8 byte = *it++;
+        *out |= (std::uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return it;
+    }
+    return nullptr;
+}
+
+//Zeros are written as a 0 token followed by the length of the run minus one
+static void put_stream(std::vector<__u8>* out, const std::vector<std::uint64_t>& vals){
+    for (std::size_t a = 0; a < vals.size();){
+        if (vals[a]){
+            put_varint(out, vals[a++]);
+            continue;
+        }
+        std::size_t run = 1;
+        while (a + run < vals.size() && !vals[a + run]) run++;
+        put_varint(out, 0);
+        put_varint(out, run - 1);
+        a += run;
+    }
+}
+static const __u8* get_stream(const __u8* it, const __u8* end, std::size_t count, std::vector<std::uint64_t>* out){
+    std::uint64_t val;
+    while (count){
+        if (!(it = get_varint(it, end, &val))) return nullptr;
+        if (val){
+            out->push_back(val);
+            count--;
+            continue;
+        }
+        if (!(it = get_varint(it, end, &val))) return nullptr;
+        if (val >= count) return nullptr;
+        out->insert(out->end(), val + 1, 0);
+        count -= val + 1;
+    }
+    return it;
+}
+
+static bool is_float(const Signal& signal){
+    return signal.is_single_float || signal.is_double_float;
+}
+static std::uint64_t sign_extend(const Signal& signal, std::uint64_t raw){
+    if (!signal.is_signed || is_float(signal) || !signal.bit_length || signal.bit_length >= 64) return raw;
+    if (!((raw >> (signal.bit_length - 1)) & 1)) return raw;
+    return raw | (~std::uint64_t{0} << signal.bit_length);
+}
+
+static void encode_block(const Signal& signal, const Pending_Block& block, std::vector<__u8>* out){
+    std::vector<std::uint64_t> tokens(block.timestamps.size());
+    std::uint64_t prev = 0;
+    std::int64_t prev_delta = 0;
+    for (std::size_t a = 0; a < block.timestamps.size(); a++){
+        std::int64_t delta = (std::int64_t)(block.timestamps[a] - prev);
+        tokens[a] = zigzag(delta - prev_delta);
+        prev = block.timestamps[a];
+        prev_delta = delta;
+    }
+    put_stream(out, tokens);
+
+    prev = 0;
+    for (std::size_t a = 0; a < block.raw.size(); a++){
+        std::uint64_t val = sign_extend(signal, block.raw[a]);
+        tokens[a] = is_float(signal) ? val ^ prev : zigzag((std::int64_t)(val - prev));
+        prev = val;
+    }
+    put_stream(out, tokens);
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+Recorder::~Recorder(){
+    if (fd >= 0) close();
+}
+
+int Recorder::open(const char* path, const Database& database, bool use_direct_io){
+    if (fd >= 0){
+        std::cerr << "Error (Wreath::DBC::Recorder): Recorder is already open\n";
+        return 1;
+    }
+    if (database.load_all()) return 1;
+    direct_io = use_direct_io;
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | (direct_io ? O_DIRECT : 0), 0644);
+    if (fd < 0 && direct_io){
+        std::cerr << "Warning (Wreath::DBC::Recorder): O_DIRECT is not supported at path '" << path << "', falling back to buffered writes\n";
+        direct_io = false;
+        fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0){
+        std::cerr << "Error (Wreath::DBC::Recorder): Failed to open recording at path '" << path << "'\n";
+        return 1;
+    }
+    staging = (__u8*)std::aligned_alloc(direct_io_align, staging_size);
+    if (!staging){
+        std::cerr << "Error (Wreath::DBC::Recorder): Failed to allocate staging buffer\n";
+        ::close(fd);
+        fd = -1;
+        return 1;
+    }
+    staging_used = 0;
+    dropped_blocks = 0;
+    file_size = 0;
+    failed = false;
+    stopping = false;
+
+    messages.clear();
+    columns.clear();
+    for (const Message& message : database.objects){
+        messages[(canid_t)message.id] = {columns.size(), message.signals.size()};
+        for (const Signal& signal : message.signals){
+            columns.push_back({signal, {}, {}});
+            columns.back().timestamps.reserve(block_samples);
+            columns.back().raw.reserve(block_samples);
+        }
+    }
+
+    std::vector<__u8> header(file_magic, file_magic + sizeof(file_magic));
+    std::uint32_t count = columns.size();
+    header.insert(header.end(), (const __u8*)&file_version, (const __u8*)&file_version + 4);
+    header.insert(header.end(), (const __u8*)&count, (const __u8*)&count + 4);
+    for (const Message& message : database.objects){
+        for (const Signal& signal : message.signals){
+            std::string name = message.name + "." + signal.name;
+            std::uint32_t id = message.id;
+            std::uint16_t name_len = name.size();
+            __u8 flags = (signal.is_signed ? flag_signed : 0) | (signal.is_single_float ? flag_single_float : 0) | (signal.is_double_float ? flag_double_float : 0);
+            header.insert(header.end(), (const __u8*)&id, (const __u8*)&id + 4);
+            header.push_back((__u8)signal.bit_length);
+            header.push_back(flags);
+            header.insert(header.end(), (const __u8*)&signal.factor, (const __u8*)&signal.factor + 4);
+            header.insert(header.end(), (const __u8*)&signal.offset, (const __u8*)&signal.offset + 4);
+            header.insert(header.end(), (const __u8*)&name_len, (const __u8*)&name_len + 2);
+            header.insert(header.end(), name.begin(), name.end());
+        }
+    }
+    if (write_bytes(header.data(), header.size())){
+        close();
+        return 1;
+    }
+
+    writer = std::thread(&Recorder::writer_loop, this);
+    return 0;
+}
+int Recorder::close(){
+    if (fd < 0) return 1;
+    for (std::uint32_t a = 0; a < columns.size(); a++) if (!columns[a].raw.empty()) flush_column(a, writer.joinable());
+    if (writer.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            stopping = true;
+        }
+        pending_cv.notify_one();
+        writer.join();
+    }
+    if (drain_staging(true)) failed = true;
+    if (direct_io && ftruncate(fd, file_size) < 0) failed = true;
+    ::close(fd);
+    fd = -1;
+    std::free(staging);
+    staging = nullptr;
+    if (dropped_blocks) std::cerr << "Error (Wreath::DBC::Recorder): Writer fell behind, dropped " << dropped_blocks << " blocks\n";
+    if (failed) std::cerr << "Error (Wreath::DBC::Recorder): Failed to write recording to disk\n";
+    return failed || dropped_blocks;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int Recorder::record(const can_frame* frame, std::uint64_t timestamp_ns){
+    if (frame->can_id & CAN_RTR_FLAG) return 2;
+    std::unordered_map<canid_t, std::pair<std::size_t, std::size_t>>::const_iterator it = messages.find(frame->can_id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+    if (it == messages.end()) return 1;
+
+    std::uint64_t payload = Package::load_payload(frame);
+    for (std::size_t a = it->second.first; a < it->second.first + it->second.second; a++){
+        Column_Buffer& column = columns[a];
+        column.timestamps.push_back(timestamp_ns);
+        column.raw.push_back(Package::extract_raw(column.signal, payload));
+        if (column.raw.size() >= block_samples) flush_column(a);
+    }
+    return 0;
+}
+void Recorder::flush_column(std::uint32_t column, bool wait){
+    Pending_Block block{std::move(columns[column].timestamps), std::move(columns[column].raw), column};
+    columns[column].timestamps = {};
+    columns[column].raw = {};
+    columns[column].timestamps.reserve(block_samples);
+    columns[column].raw.reserve(block_samples);
+    {
+        std::unique_lock<std::mutex> lock(pending_mutex);
+        std::size_t limit = std::max(max_pending_blocks, columns.size());
+        if (wait) space_cv.wait(lock, [this, limit]{return pending.size() < limit;});
+        else if (pending.size() >= limit){
+            dropped_blocks++;
+            return;
+        }
+        pending.push_back(std::move(block));
+    }
+    pending_cv.notify_one();
+}
+void Recorder::writer_loop(){
+    std::vector<__u8> encoded;
+    while (true){
+        Pending_Block block;
+        {
+            std::unique_lock<std::mutex> lock(pending_mutex);
+            pending_cv.wait(lock, [this]{return stopping || !pending.empty();});
+            if (pending.empty()) return;
+            block = std::move(pending.front());
+            pending.pop_front();
+        }
+        space_cv.notify_one();
+
+        encoded.clear();
+        encoded.resize(16);
+        encode_block(columns[block.column].signal, block, &encoded);
+        std::uint32_t fields[4] = {block_magic, block.column, (std::uint32_t)block.raw.size(), (std::uint32_t)(encoded.size() - 16)};
+        std::memcpy(encoded.data(), fields, sizeof(fields));
+        if (write_bytes(encoded.data(), encoded.size())) failed = true;
+    }
+}
+int Recorder::write_bytes(const void* src, std::size_t len){
+    const __u8* it = (const __u8*)src;
+    while (len){
+        std::size_t chunk = std::min(len, staging_size - staging_used);
+        std::memcpy(staging + staging_used, it, chunk);
+        staging_used += chunk;
+        file_size += chunk;
+        it += chunk;
+        len -= chunk;
+        if (staging_used == staging_size && drain_staging(false)) return 1;
+    }
+    return 0;
+}
+int Recorder::drain_staging(bool final){
+    std::size_t len = staging_used;
+    if (final && direct_io){
+        len = (len + direct_io_align - 1) / direct_io_align * direct_io_align;
+        std::memset(staging + staging_used, 0, len - staging_used);
+    }
+    for (std::size_t done = 0; done < len;){
+        ssize_t res = write(fd, staging + done, len - done);
+        if (res <= 0) return 1;
+        done += res;
+    }
+    staging_used = 0;
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+Recording::~Recording(){
+    close();
+}
+
+int Recording::open(const char* path){
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0){
+        std::cerr << "Error (Wreath::DBC::Recorder): Failed to open recording at path '" << path << "'\n";
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (std::size_t)info.st_size < sizeof(file_magic) + 8){
+        ::close(fd);
+        std::cerr << "Error (Wreath::DBC::Recorder): Recording at path '" << path << "' is truncated\n";
+        return 1;
+    }
+    void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return 1;
+    data = (const __u8*)map;
+    size = info.st_size;
+
+    std::uint32_t version, count;
+    const __u8* it = data + sizeof(file_magic);
+    const __u8* end = data + size;
+    std::memcpy(&version, it, 4);
+    std::memcpy(&count, it + 4, 4);
+    it += 8;
+    if (std::memcmp(data, file_magic, sizeof(file_magic)) || version != file_version){
+        std::cerr << "Error (Wreath::DBC::Recorder): File at path '" << path << "' is not a recording\n";
+        close();
+        return 1;
+    }
+
+    //Every column entry takes at least 16 bytes, so a count the file cannot hold is rejected before allocating
+    if (count > (std::size_t)(end - it) / 16){
+        std::cerr << "Error (Wreath::DBC::Recorder): Recording at path '" << path << "' is truncated\n";
+        close();
+        return 1;
+    }
+    columns.resize(count);
+    for (Recording_Column& column : columns){
+        std::uint32_t id;
+        std::uint16_t name_len;
+        if (end - it < 16){
+            close();
+            return 1;
+        }
+        std::memcpy(&id, it, 4);
+        column.info.message_id = id;
+        column.info.bit_length = it[4];
+        column.info.is_signed = it[5] & flag_signed;
+        column.info.is_single_float = it[5] & flag_single_float;
+        column.info.is_double_float = it[5] & flag_double_float;
+        std::memcpy(&column.info.factor, it + 6, 4);
+        std::memcpy(&column.info.offset, it + 10, 4);
+        std::memcpy(&name_len, it + 14, 2);
+        it += 16;
+        if (end - it < name_len){
+            close();
+            return 1;
+        }
+        column.info.name = std::string((const char*)it, name_len);
+        it += name_len;
+    }
+
+    while (end - it >= 16){
+        std::uint32_t fields[4];
+        std::memcpy(fields, it, sizeof(fields));
+        if (fields[0] != block_magic || fields[1] >= columns.size() || (std::size_t)(end - it - 16) < fields[3]) break;
+        columns[fields[1]].blocks.push_back(it - data);
+        it += 16 + fields[3];
+    }
+    return 0;
+}
+int Recording::close(){
+    int res = 0;
+    if (data) res = munmap((void*)data, size);
+    data = nullptr;
+    size = 0;
+    columns.clear();
+    return res;
+}
+
+int Recording::get_column(const std::string& name, std::span<const std::uint64_t>* out_timestamps, std::span<const double>* out_values){
+    std::vector<Recording_Column>::iterator it = std::find_if(columns.begin(), columns.end(), [&name](const Recording_Column& column){return column.info.name == name;});
+    if (it == columns.end()) return 1;
+    if (!it->decoded && decode_column(&*it)) return 1;
+    *out_timestamps = it->timestamps;
+    *out_values = it->values;
+    return 0;
+}
+int Recording::decode_column(Recording_Column* column){
+    Signal signal{};
+    signal.bit_length = column->info.bit_length;
+    signal.factor = column->info.factor;
+    signal.offset = column->info.offset;
+    signal.is_signed = column->info.is_signed;
+    signal.is_single_float = column->info.is_single_float;
+    signal.is_double_float = column->info.is_double_float;
+
+    std::vector<std::uint64_t> tokens;
+    column->timestamps.clear();
+    column->values.clear();
+    for (std::size_t offset : column->blocks){
+        std::uint32_t fields[4];
+        std::memcpy(fields, data + offset, sizeof(fields));
+        const __u8* it = data + offset + 16;
+        const __u8* end = it + fields[3];
+
+        tokens.clear();
+        if (!(it = get_stream(it, end, fields[2], &tokens))){
+            std::cerr << "Error (Wreath::DBC::Recorder): Corrupt block in column '" << column->info.name << "'\n";
+            return 1;
+        }
+        std::uint64_t prev = 0;
+        std::int64_t prev_delta = 0;
+        for (std::uint64_t token : tokens){
+            prev_delta += unzigzag(token);
+            prev += prev_delta;
+            column->timestamps.push_back(prev);
+        }
+
+        tokens.clear();
+        if (!get_stream(it, end, fields[2], &tokens)){
+            std::cerr << "Error (Wreath::DBC::Recorder): Corrupt block in column '" << column->info.name << "'\n";
+            return 1;
+        }
+        prev = 0;
+        for (std::uint64_t token : tokens){
+            prev = is_float(signal) ? prev ^ token : prev + unzigzag(token);
+            column->values.push_back(Package::raw_to_physical(signal, prev));
+        }
+    }
+    column->decoded = true;
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
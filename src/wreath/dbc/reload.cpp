@@ -0,0 +1,201 @@
+#include <unordered_set>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+#include "wreath/dbc/package.hpp"
+#include "wreath/dbc/reload.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Reload{
+
+//---------------------------------------------------------------------------------------------------------
+
+static bool same_signal(const Signal& lhs, const Signal& rhs){
+    return lhs.name == rhs.name && lhs.unit == rhs.unit && lhs.bit_start == rhs.bit_start && lhs.bit_length == rhs.bit_length &&
+        lhs.factor == rhs.factor && lhs.offset == rhs.offset && lhs.min == rhs.min && lhs.max == rhs.max &&
+        lhs.is_little_endian == rhs.is_little_endian && lhs.is_signed == rhs.is_signed &&
+        lhs.is_single_float == rhs.is_single_float && lhs.is_double_float == rhs.is_double_float &&
+        lhs.value_enum == rhs.value_enum && lhs.receivers == rhs.receivers;
+}
+
+bool Database_Diff::empty() const{
+    return added.empty() && removed.empty() && changed.empty();
+}
+
+int diff_message(const Message& old_message, const Message& new_message, Message_Diff* out_diff){
+    *out_diff = {};
+    out_diff->id = new_message.id;
+    for (const Signal& signal : new_message.signals){
+        std::vector<Signal>::const_iterator it = std::find_if(old_message.signals.begin(), old_message.signals.end(), [&signal](const Signal& old_signal){return old_signal.name == signal.name;});
+        if (it == old_message.signals.end()) out_diff->added_signals.push_back(signal.name);
+        else if (!same_signal(*it, signal)) out_diff->changed_signals.push_back(signal.name);
+    }
+    for (const Signal& signal : old_message.signals){
+        std::vector<Signal>::const_iterator it = std::find_if(new_message.signals.begin(), new_message.signals.end(), [&signal](const Signal& new_signal){return new_signal.name == signal.name;});
+        if (it == new_message.signals.end()) out_diff->removed_signals.push_back(signal.name);
+    }
+    bool changed = old_message.name != new_message.name || old_message.sender != new_message.sender || old_message.length != new_message.length || old_message.cycle_time != new_message.cycle_time;
+    if (!changed && out_diff->added_signals.empty() && out_diff->removed_signals.empty() && out_diff->changed_signals.empty()) return 0;
+    return 2;
+}
+int diff_databases(const Database& old_database, const Database& new_database, Database_Diff* out_diff){
+    *out_diff = {};
+    const Message* old_message;
+    Message_Diff message_diff;
+    for (const Message& message : new_database.objects){
+        std::vector<Message>::const_iterator it = std::lower_bound(old_database.objects.begin(), old_database.objects.end(), message.id, [](const Message& lhs, std::size_t rhs){return lhs.id < rhs;});
+        if (it == old_database.objects.end() || it->id != message.id){
+            out_diff->added.push_back(message.id);
+            continue;
+        }
+        old_message = &*it;
+        if (diff_message(*old_message, message, &message_diff) == 2) out_diff->changed.push_back(message_diff);
+    }
+    for (const Message& message : old_database.objects){
+        std::vector<Message>::const_iterator it = std::lower_bound(new_database.objects.begin(), new_database.objects.end(), message.id, [](const Message& lhs, std::size_t rhs){return lhs.id < rhs;});
+        if (it == new_database.objects.end() || it->id != message.id) out_diff->removed.push_back(message.id);
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+const Snapshot_Entry* Snapshot::get_message_bid(std::size_t id) const{
+    std::unordered_map<canid_t, Snapshot_Entry>::const_iterator it = index.find((canid_t)id);
+    if (it == index.end()) return nullptr;
+    return &it->second;
+}
+
+static Snapshot_Entry build_entry(const Message& message){
+    std::shared_ptr<Message_Plan> plan = std::make_shared<Message_Plan>();
+    plan->masks.reserve(message.signals.size());
+    for (const Signal& signal : message.signals) plan->masks.push_back(Package::signal_mask(signal));
+    return {std::make_shared<const Message>(message), plan};
+}
+
+//Must be called with 'writer_mutex' held
+static std::size_t reclaim_retired(Reloader* reloader){
+    std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+    for (const std::unique_ptr<Reader_Handle>& reader : reloader->readers){
+        oldest = std::min(oldest, reader->observed.load());
+    }
+    std::size_t freed = 0;
+    std::vector<std::pair<const Snapshot*, std::uint64_t>>::iterator it = std::remove_if(reloader->retired.begin(), reloader->retired.end(), [&oldest, &freed](const std::pair<const Snapshot*, std::uint64_t>& retired){
+        if (retired.second > oldest) return false;
+        delete retired.first;
+        freed++;
+        return true;
+    });
+    reloader->retired.erase(it, reloader->retired.end());
+    return freed;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+Reloader::~Reloader(){
+    if (worker.joinable()) worker.join();
+    for (const std::pair<const Snapshot*, std::uint64_t>& retired_snapshot : retired) delete retired_snapshot.first;
+    delete current.load();
+}
+
+int Reloader::load(const Database& database, Database_Diff* out_diff){
+    if (database.load_all()) return 1;
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    const Snapshot* old_snapshot = current.load(std::memory_order_acquire);
+    Snapshot* snapshot = new Snapshot;
+    Database_Diff diff;
+    Message_Diff message_diff;
+
+    snapshot->version = database.version;
+    snapshot->nodes = database.nodes;
+    if (old_snapshot) snapshot->index = old_snapshot->index;
+    snapshot->index.reserve(database.objects.size());
+
+    std::unordered_set<canid_t> present;
+    present.reserve(database.objects.size());
+    for (const Message& message : database.objects){
+        canid_t id = (canid_t)message.id;
+        present.insert(id);
+        std::unordered_map<canid_t, Snapshot_Entry>::iterator it = snapshot->index.find(id);
+        if (it == snapshot->index.end()){
+            diff.added.push_back(message.id);
+            snapshot->index.emplace(id, build_entry(message));
+        } else if (diff_message(*it->second.message, message, &message_diff) == 2){
+            diff.changed.push_back(message_diff);
+            it->second = build_entry(message);
+        }
+    }
+    if (old_snapshot){
+        for (const std::pair<const canid_t, Snapshot_Entry>& entry : old_snapshot->index){
+            if (present.count(entry.first)) continue;
+            diff.removed.push_back(entry.second.message->id);
+            snapshot->index.erase(entry.first);
+        }
+    }
+
+    std::uint64_t next_epoch = epoch.load() + 1;
+    snapshot->epoch = next_epoch;
+    current.store(snapshot, std::memory_order_release);
+    epoch.store(next_epoch);
+    if (old_snapshot) retired.push_back({old_snapshot, next_epoch});
+    reclaim_retired(this);
+
+    if (out_diff) *out_diff = std::move(diff);
+    return 0;
+}
+int Reloader::reload(std::ifstream& dbc_file, Database_Diff* out_diff){
+    Database database;
+    if (database.from_file(dbc_file)){
+        std::cerr << "Error (Wreath::DBC::Reload): Failed to parse DBC file, keeping the current snapshot\n";
+        return 1;
+    }
+    return load(database, out_diff);
+}
+int Reloader::reload_async(const std::string& path, std::function<void(int, const Database_Diff&)> on_done){
+    if (reloading.exchange(true, std::memory_order_acquire)) return 2;
+    //The previous worker has already cleared 'reloading', so this only waits for it to return
+    if (worker.joinable()) worker.join();
+    worker = std::thread([this, path, on_done]{
+        Database_Diff diff;
+        std::ifstream dbc_file(path);
+        int res = 1;
+        if (!dbc_file.is_open()) std::cerr << "Error (Wreath::DBC::Reload): Failed to open file at path '" << path << "'\n";
+        else res = reload(dbc_file, &diff);
+        if (on_done) on_done(res, diff);
+        reloading.store(false, std::memory_order_release);
+    });
+    return 0;
+}
+std::size_t Reloader::reclaim(){
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    return reclaim_retired(this);
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+Reader_Handle* Reloader::register_reader(){
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    readers.push_back(std::make_unique<Reader_Handle>());
+    readers.back()->observed.store(epoch.load());
+    return readers.back().get();
+}
+void Reloader::unregister_reader(Reader_Handle* reader){
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    std::vector<std::unique_ptr<Reader_Handle>>::iterator it = std::find_if(readers.begin(), readers.end(), [reader](const std::unique_ptr<Reader_Handle>& handle){return handle.get() == reader;});
+    if (it != readers.end()) readers.erase(it);
+    reclaim_retired(this);
+}
+const Snapshot* Reloader::read() const{
+    return current.load(std::memory_order_acquire);
+}
+void Reloader::quiescent(Reader_Handle* reader) const{
+    reader->observed.store(epoch.load());
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
@@ -0,0 +1,352 @@
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <new>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "wreath/dbc/shared.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Shared{
+
+//---------------------------------------------------------------------------------------------------------
+
+static constexpr char image_magic[8] = {'W', 'R', 'D', 'B', 'C', 'S', 'H', 'M'};
+static constexpr std::uint32_t image_version = 2;
+static constexpr std::uint64_t control_magic = 0x4C52544342444257;
+static constexpr std::size_t attach_retries = 16;
+
+static std::string shm_name(const char* name){
+    return name[0] == '/' ? std::string(name) : "/" + std::string(name);
+}
+static std::string image_name(const std::string& name, std::uint64_t generation){
+    return name + "." + std::to_string(generation);
+}
+static std::size_t align_up(std::size_t val){
+    return (val + 7) & ~std::size_t{7};
+}
+
+struct Image_Builder{
+    std::unordered_map<std::string, String_Ref> interned;
+    std::vector<Flat_Message> messages;
+    std::vector<std::uint32_t> name_index;
+    std::vector<Flat_Signal> signals;
+    std::vector<Flat_Enum> enums;
+    std::vector<String_Ref> refs;
+    std::string strings;
+
+    String_Ref intern(const std::string& str){
+        std::unordered_map<std::string, String_Ref>::const_iterator it = interned.find(str);
+        if (it != interned.end()) return it->second;
+        String_Ref ref{(std::uint32_t)strings.size(), (std::uint32_t)str.size()};
+        strings += str;
+        interned.emplace(str, ref);
+        return ref;
+    }
+};
+
+//---------------------------------------------------------------------------------------------------------
+
+int build_image(const Database& database, std::uint64_t generation, std::vector<std::uint8_t>* out_image){
+    if (database.load_all()) return 1;
+    Image_Builder builder;
+    Image_Header header{};
+    std::memcpy(header.magic, image_magic, sizeof(image_magic));
+    header.version = image_version;
+    header.generation = generation;
+    header.db_version = builder.intern(database.version);
+
+    for (const Message& message : database.objects){
+        Flat_Message flat{};
+        flat.id = message.id;
+        flat.length = message.length;
+        flat.cycle_time = message.cycle_time;
+        flat.name = builder.intern(message.name);
+        flat.sender = builder.intern(message.sender);
+        flat.signal_begin = builder.signals.size();
+        flat.signal_count = message.signals.size();
+        for (const Signal& signal : message.signals){
+            Flat_Signal flat_signal{};
+            flat_signal.name = builder.intern(signal.name);
+            flat_signal.unit = builder.intern(signal.unit);
+            flat_signal.bit_start = signal.bit_start;
+            flat_signal.bit_length = signal.bit_length;
+            flat_signal.factor = signal.factor;
+            flat_signal.offset = signal.offset;
+            flat_signal.min = signal.min;
+            flat_signal.max = signal.max;
+            flat_signal.is_little_endian = signal.is_little_endian;
+            flat_signal.is_signed = signal.is_signed;
+            flat_signal.is_single_float = signal.is_single_float;
+            flat_signal.is_double_float = signal.is_double_float;
+            flat_signal.enum_begin = builder.enums.size();
+            flat_signal.enum_count = signal.value_enum.size();
+            for (const std::pair<std::size_t, std::string>& desc : signal.value_enum) builder.enums.push_back({desc.first, builder.intern(desc.second)});
+            flat_signal.receiver_begin = builder.refs.size();
+            flat_signal.receiver_count = signal.receivers.size();
+            for (const std::string& receiver : signal.receivers) builder.refs.push_back(builder.intern(receiver));
+            builder.signals.push_back(flat_signal);
+        }
+        builder.messages.push_back(flat);
+    }
+    header.node_begin = builder.refs.size();
+    header.node_count = database.nodes.size();
+    for (const std::string& node : database.nodes) builder.refs.push_back(builder.intern(node));
+
+    builder.name_index.resize(builder.messages.size());
+    for (std::uint32_t a = 0; a < builder.name_index.size(); a++) builder.name_index[a] = a;
+    std::sort(builder.name_index.begin(), builder.name_index.end(), [&database](std::uint32_t lhs, std::uint32_t rhs){return database.objects[lhs].name < database.objects[rhs].name;});
+
+    header.message_count = builder.messages.size();
+    header.signal_count = builder.signals.size();
+    header.enum_count = builder.enums.size();
+    header.ref_count = builder.refs.size();
+    header.messages_offset = align_up(sizeof(Image_Header));
+    header.name_index_offset = align_up(header.messages_offset + builder.messages.size() * sizeof(Flat_Message));
+    header.signals_offset = align_up(header.name_index_offset + builder.name_index.size() * sizeof(std::uint32_t));
+    header.enums_offset = align_up(header.signals_offset + builder.signals.size() * sizeof(Flat_Signal));
+    header.refs_offset = align_up(header.enums_offset + builder.enums.size() * sizeof(Flat_Enum));
+    header.strings_offset = align_up(header.refs_offset + builder.refs.size() * sizeof(String_Ref));
+    header.size = header.strings_offset + builder.strings.size();
+
+    out_image->assign(header.size, 0);
+    std::uint8_t* image = out_image->data();
+    std::memcpy(image, &header, sizeof(header));
+    std::memcpy(image + header.messages_offset, builder.messages.data(), builder.messages.size() * sizeof(Flat_Message));
+    std::memcpy(image + header.name_index_offset, builder.name_index.data(), builder.name_index.size() * sizeof(std::uint32_t));
+    std::memcpy(image + header.signals_offset, builder.signals.data(), builder.signals.size() * sizeof(Flat_Signal));
+    std::memcpy(image + header.enums_offset, builder.enums.data(), builder.enums.size() * sizeof(Flat_Enum));
+    std::memcpy(image + header.refs_offset, builder.refs.data(), builder.refs.size() * sizeof(String_Ref));
+    std::memcpy(image + header.strings_offset, builder.strings.data(), builder.strings.size());
+    return 0;
+}
+
+int publish(const Database& database, const char* name, std::uint64_t* out_generation){
+    std::string control_name = shm_name(name);
+    int control_fd = shm_open(control_name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (control_fd < 0){
+        std::cerr << "Error (Wreath::DBC::Shared): Failed to open control segment '" << control_name << "'\n";
+        return 1;
+    }
+    struct stat info;
+    if (fstat(control_fd, &info) < 0 || ((std::size_t)info.st_size < sizeof(Control_Block) && ftruncate(control_fd, sizeof(Control_Block)) < 0)){
+        close(control_fd);
+        std::cerr << "Error (Wreath::DBC::Shared): Failed to size control segment '" << control_name << "'\n";
+        return 1;
+    }
+    void* control_map = mmap(nullptr, sizeof(Control_Block), PROT_READ | PROT_WRITE, MAP_SHARED, control_fd, 0);
+    close(control_fd);
+    if (control_map == MAP_FAILED) return 1;
+    Control_Block* control = (Control_Block*)control_map;
+    if (control->magic != control_magic){
+        new (&control->generation) std::atomic<std::uint64_t>(0);
+        control->magic = control_magic;
+    }
+
+    std::uint64_t previous = control->generation.load(std::memory_order_acquire);
+    std::uint64_t generation = previous + 1;
+    std::vector<std::uint8_t> image;
+    if (build_image(database, generation, &image)){
+        munmap(control_map, sizeof(Control_Block));
+        return 1;
+    }
+
+    std::string segment_name = image_name(control_name, generation);
+    int image_fd = shm_open(segment_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (image_fd < 0 || ftruncate(image_fd, image.size()) < 0){
+        if (image_fd >= 0) close(image_fd);
+        munmap(control_map, sizeof(Control_Block));
+        std::cerr << "Error (Wreath::DBC::Shared): Failed to create image segment '" << segment_name << "'\n";
+        return 1;
+    }
+    void* image_map = mmap(nullptr, image.size(), PROT_READ | PROT_WRITE, MAP_SHARED, image_fd, 0);
+    close(image_fd);
+    if (image_map == MAP_FAILED){
+        shm_unlink(segment_name.c_str());
+        munmap(control_map, sizeof(Control_Block));
+        return 1;
+    }
+    std::memcpy(image_map, image.data(), image.size());
+    munmap(image_map, image.size());
+
+    control->generation.store(generation, std::memory_order_release);
+    if (previous) shm_unlink(image_name(control_name, previous).c_str());
+    munmap(control_map, sizeof(Control_Block));
+    if (out_generation) *out_generation = generation;
+    return 0;
+}
+int unpublish(const char* name){
+    std::string control_name = shm_name(name);
+    int control_fd = shm_open(control_name.c_str(), O_RDONLY, 0);
+    if (control_fd < 0) return 1;
+    void* control_map = mmap(nullptr, sizeof(Control_Block), PROT_READ, MAP_SHARED, control_fd, 0);
+    close(control_fd);
+    if (control_map != MAP_FAILED){
+        std::uint64_t generation = ((const Control_Block*)control_map)->generation.load(std::memory_order_acquire);
+        if (generation) shm_unlink(image_name(control_name, generation).c_str());
+        munmap(control_map, sizeof(Control_Block));
+    }
+    return shm_unlink(control_name.c_str());
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+Shared_Database::~Shared_Database(){
+    detach();
+}
+
+int Shared_Database::attach(const char* shared_name){
+    detach();
+    name = shm_name(shared_name);
+    int control_fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (control_fd < 0){
+        std::cerr << "Error (Wreath::DBC::Shared): No database has been published as '" << name << "'\n";
+        return 1;
+    }
+    void* control_map = mmap(nullptr, sizeof(Control_Block), PROT_READ, MAP_SHARED, control_fd, 0);
+    close(control_fd);
+    if (control_map == MAP_FAILED) return 1;
+    control = (const Control_Block*)control_map;
+    if (control->magic != control_magic){
+        detach();
+        return 1;
+    }
+
+    //The publisher may unlink the generation we just read before we open it, so retry with the newer one
+    for (std::size_t a = 0; a < attach_retries; a++){
+        std::uint64_t generation = control->generation.load(std::memory_order_acquire);
+        if (!generation) break;
+        if (!map_generation(generation)) return 0;
+    }
+    std::cerr << "Error (Wreath::DBC::Shared): Failed to map database published as '" << name << "'\n";
+    detach();
+    return 1;
+}
+int Shared_Database::detach(){
+    if (header) munmap((void*)header, header->size);
+    if (control) munmap((void*)control, sizeof(Control_Block));
+    header = nullptr;
+    control = nullptr;
+    return 0;
+}
+bool Shared_Database::is_stale() const{
+    return control && header && control->generation.load(std::memory_order_acquire) != header->generation;
+}
+int Shared_Database::refresh(){
+    if (!control) return 1;
+    for (std::size_t a = 0; a < attach_retries; a++){
+        if (!is_stale()) return 0;
+        if (!map_generation(control->generation.load(std::memory_order_acquire))) return 0;
+    }
+    return 1;
+}
+int Shared_Database::map_generation(std::uint64_t generation){
+    int image_fd = shm_open(image_name(name, generation).c_str(), O_RDONLY, 0);
+    if (image_fd < 0) return 1;
+    struct stat info;
+    if (fstat(image_fd, &info) < 0 || (std::size_t)info.st_size < sizeof(Image_Header)){
+        close(image_fd);
+        return 1;
+    }
+    void* image_map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, image_fd, 0);
+    close(image_fd);
+    if (image_map == MAP_FAILED) return 1;
+
+    const Image_Header* image = (const Image_Header*)image_map;
+    if (std::memcmp(image->magic, image_magic, sizeof(image_magic)) || image->version != image_version || image->size > (std::size_t)info.st_size || image->generation != generation){
+        munmap(image_map, info.st_size);
+        return 1;
+    }
+    if (header) munmap((void*)header, header->size);
+    header = image;
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+std::string_view Shared_Database::string(String_Ref ref) const{
+    return std::string_view((const char*)header + header->strings_offset + ref.offset, ref.length);
+}
+std::span<const Flat_Message> Shared_Database::messages() const{
+    if (!header) return {};
+    return {(const Flat_Message*)((const char*)header + header->messages_offset), header->message_count};
+}
+std::span<const Flat_Signal> Shared_Database::signals(const Flat_Message& message) const{
+    return {(const Flat_Signal*)((const char*)header + header->signals_offset) + message.signal_begin, message.signal_count};
+}
+std::span<const Flat_Enum> Shared_Database::value_enum(const Flat_Signal& signal) const{
+    return {(const Flat_Enum*)((const char*)header + header->enums_offset) + signal.enum_begin, signal.enum_count};
+}
+std::span<const String_Ref> Shared_Database::receivers(const Flat_Signal& signal) const{
+    return {(const String_Ref*)((const char*)header + header->refs_offset) + signal.receiver_begin, signal.receiver_count};
+}
+std::span<const String_Ref> Shared_Database::nodes() const{
+    if (!header) return {};
+    return {(const String_Ref*)((const char*)header + header->refs_offset) + header->node_begin, header->node_count};
+}
+
+int Shared_Database::get_message_bid(std::size_t id, const Flat_Message** out_message) const{
+    std::span<const Flat_Message> objects = messages();
+    std::span<const Flat_Message>::iterator it = std::lower_bound(objects.begin(), objects.end(), id, [](const Flat_Message& lhs, std::size_t rhs){return lhs.id < rhs;});
+    if (it == objects.end()) return 1;
+    if (it->id != id) return 1;
+    *out_message = &*it;
+    return 0;
+}
+int Shared_Database::get_message_bname(std::string_view message_name, const Flat_Message** out_message) const{
+    if (!header) return 1;
+    std::span<const Flat_Message> objects = messages();
+    std::span<const std::uint32_t> index((const std::uint32_t*)((const char*)header + header->name_index_offset), header->message_count);
+    std::span<const std::uint32_t>::iterator it = std::lower_bound(index.begin(), index.end(), message_name, [this, &objects](std::uint32_t lhs, std::string_view rhs){return string(objects[lhs].name) < rhs;});
+    if (it == index.end()) return 1;
+    if (string(objects[*it].name) != message_name) return 1;
+    *out_message = &objects[*it];
+    return 0;
+}
+int Shared_Database::get_signal_bname(const Flat_Message& message, std::string_view signal_name, const Flat_Signal** out_signal) const{
+    std::span<const Flat_Signal> message_signals = signals(message);
+    std::span<const Flat_Signal>::iterator it = std::find_if(message_signals.begin(), message_signals.end(), [this, &signal_name](const Flat_Signal& signal){return string(signal.name) == signal_name;});
+    if (it == message_signals.end()) return 1;
+    *out_signal = &*it;
+    return 0;
+}
+int Shared_Database::to_message(const Flat_Message& message, Message* out_message) const{
+    *out_message = {};
+    out_message->id = message.id;
+    out_message->length = message.length;
+    out_message->cycle_time = message.cycle_time;
+    out_message->name = string(message.name);
+    out_message->sender = string(message.sender);
+    for (const Flat_Signal& flat : signals(message)){
+        Signal signal{};
+        signal.name = string(flat.name);
+        signal.unit = string(flat.unit);
+        signal.bit_start = flat.bit_start;
+        signal.bit_length = flat.bit_length;
+        signal.factor = flat.factor;
+        signal.offset = flat.offset;
+        signal.min = flat.min;
+        signal.max = flat.max;
+        signal.is_little_endian = flat.is_little_endian;
+        signal.is_signed = flat.is_signed;
+        signal.is_single_float = flat.is_single_float;
+        signal.is_double_float = flat.is_double_float;
+        for (const Flat_Enum& desc : value_enum(flat)) signal.value_enum.push_back({desc.value, std::string(string(desc.text))});
+        for (const String_Ref& receiver : receivers(flat)) signal.receivers.push_back(std::string(string(receiver)));
+        out_message->signals.push_back(signal);
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
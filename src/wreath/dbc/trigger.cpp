@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <bit>
+
+#include "wreath/dbc/package.hpp"
+#include "wreath/dbc/trigger.hpp"
+
+namespace Wreath{
+namespace DBC{
+namespace Trigger{
+
+//---------------------------------------------------------------------------------------------------------
+
+//Postfix form of a parsed trigger, resolved against each candidate message afterwards
+struct Term{
+    Opcode op;
+    Compare compare;
+    std::string message;
+    std::string signal;
+    double threshold;
+};
+
+struct Cursor{
+    const std::string& text;
+    std::size_t pos;
+};
+
+static void skip_space(Cursor* cursor){
+    while (cursor->pos < cursor->text.size() && std::isspace((unsigned char)cursor->text[cursor->pos])) cursor->pos++;
+}
+static bool accept(Cursor* cursor, const char* token){
+    skip_space(cursor);
+    std::size_t len = std::char_traits<char>::length(token);
+    if (cursor->text.compare(cursor->pos, len, token)) return false;
+    cursor->pos += len;
+    return true;
+}
+static int parse_error(const Cursor& cursor, const char* what){
+    std::cerr << "Error (Wreath::DBC::Trigger, Column #" << cursor.pos + 1 << "): " << what << " in '" << cursor.text << "'\n";
+    return 1;
+}
+
+static bool parse_identifier(Cursor* cursor, std::string* out_identifier){
+    skip_space(cursor);
+    std::size_t start = cursor->pos;
+    if (start >= cursor->text.size() || !(std::isalpha((unsigned char)cursor->text[start]) || cursor->text[start] == '_')) return false;
+    while (cursor->pos < cursor->text.size() && (std::isalnum((unsigned char)cursor->text[cursor->pos]) || cursor->text[cursor->pos] == '_')) cursor->pos++;
+    *out_identifier = cursor->text.substr(start, cursor->pos - start);
+    return true;
+}
+static bool parse_number(Cursor* cursor, double* out_number){
+    skip_space(cursor);
+    const char* start = cursor->text.c_str() + cursor->pos;
+    char* end;
+    if (!*start || !(std::isdigit((unsigned char)*start) || *start == '-' || *start == '+' || *start == '.')) return false;
+    *out_number = std::strtod(start, &end);
+    if (end == start) return false;
+    cursor->pos += end - start;
+    return true;
+}
+static bool parse_compare(Cursor* cursor, Compare* out_compare){
+    if (accept(cursor, "==")) *out_compare = Compare::Equal;
+    else if (accept(cursor, "!=")) *out_compare = Compare::Not_Equal;
+    else if (accept(cursor, "<=")) *out_compare = Compare::Less_Equal;
+    else if (accept(cursor, ">=")) *out_compare = Compare::Greater_Equal;
+    else if (accept(cursor, "<")) *out_compare = Compare::Less;
+    else if (accept(cursor, ">")) *out_compare = Compare::Greater;
+    else return false;
+    return true;
+}
+static Compare mirror(Compare compare){
+    switch (compare){
+        case Compare::Less: return Compare::Greater;
+        case Compare::Less_Equal: return Compare::Greater_Equal;
+        case Compare::Greater: return Compare::Less;
+        case Compare::Greater_Equal: return Compare::Less_Equal;
+        default: return compare;
+    }
+}
+
+static bool parse_signal(Cursor* cursor, Term* out_term){
+    std::string first;
+    if (!parse_identifier(cursor, &first)) return false;
+    if (cursor->pos < cursor->text.size() && cursor->text[cursor->pos] == '.'){
+        cursor->pos++;
+        out_term->message = first;
+        return parse_identifier(cursor, &out_term->signal);
+    }
+    out_term->signal = first;
+    return true;
+}
+
+static int parse_expression(Cursor* cursor, std::vector<Term>* out_terms);
+
+static int parse_unary(Cursor* cursor, std::vector<Term>* out_terms){
+    if (accept(cursor, "!")){
+        if (parse_unary(cursor, out_terms)) return 1;
+        out_terms->push_back({Opcode::Not, Compare::Equal, "", "", 0.0});
+        return 0;
+    }
+    if (accept(cursor, "(")){
+        if (parse_expression(cursor, out_terms)) return 1;
+        if (!accept(cursor, ")")) return parse_error(*cursor, "Expected ')'");
+        return 0;
+    }
+
+    Term term{Opcode::Compare_Physical, Compare::Not_Equal, "", "", 0.0};
+    if (parse_number(cursor, &term.threshold)){
+        if (!parse_compare(cursor, &term.compare)) return parse_error(*cursor, "Expected a comparison after number");
+        if (!parse_signal(cursor, &term)) return parse_error(*cursor, "Expected a signal name");
+        term.compare = mirror(term.compare);
+    } else if (parse_signal(cursor, &term)){
+        std::size_t pos = cursor->pos;
+        if (parse_compare(cursor, &term.compare)){
+            if (!parse_number(cursor, &term.threshold)) return parse_error(*cursor, "Expected a number");
+        } else cursor->pos = pos;
+    } else return parse_error(*cursor, "Expected a signal name, number, '!' or '('");
+    out_terms->push_back(term);
+    return 0;
+}
+static int parse_and(Cursor* cursor, std::vector<Term>* out_terms){
+    if (parse_unary(cursor, out_terms)) return 1;
+    while (accept(cursor, "&&")){
+        if (parse_unary(cursor, out_terms)) return 1;
+        out_terms->push_back({Opcode::And, Compare::Equal, "", "", 0.0});
+    }
+    return 0;
+}
+static int parse_expression(Cursor* cursor, std::vector<Term>* out_terms){
+    if (parse_and(cursor, out_terms)) return 1;
+    while (accept(cursor, "||")){
+        if (parse_and(cursor, out_terms)) return 1;
+        out_terms->push_back({Opcode::Or, Compare::Equal, "", "", 0.0});
+    }
+    return 0;
+}
+static int parse_hold(Cursor* cursor, std::uint64_t* out_hold_ns){
+    *out_hold_ns = 0;
+    std::size_t pos = cursor->pos;
+    std::string keyword;
+    if (!parse_identifier(cursor, &keyword) || keyword != "for"){
+        cursor->pos = pos;
+        return 0;
+    }
+    double amount;
+    if (!parse_number(cursor, &amount) || amount < 0.0) return parse_error(*cursor, "Expected a duration after 'for'");
+    if (accept(cursor, "ms")) amount *= 1e6;
+    else if (accept(cursor, "us")) amount *= 1e3;
+    else if (accept(cursor, "s")) amount *= 1e9;
+    else return parse_error(*cursor, "Expected 'us', 'ms' or 's'");
+    *out_hold_ns = (std::uint64_t)amount;
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+template<typename T>
+static bool compare_values(Compare compare, T lhs, T rhs){
+    switch (compare){
+        case Compare::Equal: return lhs == rhs;
+        case Compare::Not_Equal: return lhs != rhs;
+        case Compare::Less: return lhs < rhs;
+        case Compare::Less_Equal: return lhs <= rhs;
+        case Compare::Greater: return lhs > rhs;
+        case Compare::Greater_Equal: return lhs >= rhs;
+    }
+    return false;
+}
+
+static Instruction constant(bool value){
+    Instruction instruction{};
+    instruction.op = Opcode::Constant;
+    instruction.value = value;
+    return instruction;
+}
+
+//Finds the raw boundary where the physical comparison flips. The double estimate is only a
+//starting point; the search then steps with raw_to_physical itself, so the compiled comparison
+//agrees bit-for-bit with decoding the signal and comparing afterwards
+static Instruction compile_raw(const Signal& signal, const Instruction& base, Compare compare, double threshold){
+    std::int64_t lo = signal.is_signed ? -(std::int64_t{1} << (signal.bit_length - 1)) : 0;
+    std::int64_t hi = signal.is_signed ? (std::int64_t{1} << (signal.bit_length - 1)) - 1 : (std::int64_t{1} << signal.bit_length) - 1;
+    std::uint64_t mask = (std::uint64_t{1} << signal.bit_length) - 1;
+    auto holds = [&](Compare with, std::int64_t raw){
+        return compare_values(with, Package::raw_to_physical(signal, (std::uint64_t)raw & mask), threshold);
+    };
+
+    if (std::isnan(threshold)) return constant(compare == Compare::Not_Equal);
+    if (signal.factor == 0.0f) return constant(holds(compare, 0));
+    double estimate = std::clamp(std::floor((threshold - signal.offset) / signal.factor), (double)lo, (double)hi);
+    std::int64_t k = (std::int64_t)estimate;
+    Instruction instruction = base;
+
+    if (compare == Compare::Equal || compare == Compare::Not_Equal){
+        for (std::int64_t candidate : {k, k + 1, k - 1}){
+            if (candidate < lo || candidate > hi || !holds(Compare::Equal, candidate)) continue;
+            instruction.compare = compare;
+            instruction.raw_threshold = candidate;
+            return instruction;
+        }
+        return constant(compare == Compare::Not_Equal);
+    }
+
+    bool upward = (compare == Compare::Greater || compare == Compare::Greater_Equal) == (signal.factor > 0.0f);
+    if (upward){
+        //Smallest raw that holds, hi + 1 if none
+        if (holds(compare, k)) while (k > lo && holds(compare, k - 1)) k--;
+        else while (k <= hi && !holds(compare, k)) k++;
+        if (k == lo) return constant(true);
+        if (k > hi) return constant(false);
+        instruction.compare = Compare::Greater_Equal;
+    } else{
+        //Largest raw that holds, lo - 1 if none
+        if (holds(compare, k)) while (k < hi && holds(compare, k + 1)) k++;
+        else while (k >= lo && !holds(compare, k)) k--;
+        if (k == hi) return constant(true);
+        if (k < lo) return constant(false);
+        instruction.compare = Compare::Less_Equal;
+    }
+    instruction.raw_threshold = k;
+    return instruction;
+}
+
+static int compile_term(const Signal& signal, const Term& term, Instruction* out_instruction){
+    std::uint64_t mask = Package::signal_mask(signal);
+    if (!mask) return 1;
+
+    Instruction instruction{};
+    instruction.op = Opcode::Compare_Physical;
+    instruction.compare = term.compare;
+    instruction.threshold = term.threshold;
+    instruction.signal = &signal;
+    instruction.is_signed = signal.is_signed;
+    instruction.bit_length = signal.bit_length;
+    instruction.mask = signal.bit_length == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << signal.bit_length) - 1;
+    if (signal.is_little_endian) instruction.shift = signal.bit_start;
+    else{
+        instruction.swap = true;
+        instruction.shift = (7 - signal.bit_start / 8) * 8 + signal.bit_start % 8 + 1 - signal.bit_length;
+    }
+
+    if (signal.is_single_float || signal.is_double_float || signal.bit_length > 62) *out_instruction = instruction;
+    else{
+        instruction.op = Opcode::Compare_Raw;
+        *out_instruction = compile_raw(signal, instruction, term.compare, term.threshold);
+    }
+    return 0;
+}
+
+//Returns 0 if every signal resolved in 'message', 2 if the trigger does not apply to it, 1 on error
+static int compile_program(const Message& message, const std::vector<Term>& terms, Program* out_program){
+    out_program->code.clear();
+    out_program->code.reserve(terms.size());
+    for (const Term& term : terms){
+        if (term.op != Opcode::Compare_Physical){
+            Instruction instruction{};
+            instruction.op = term.op;
+            out_program->code.push_back(instruction);
+            continue;
+        }
+        if (!term.message.empty() && term.message != message.name) return 2;
+        std::vector<Signal>::const_iterator it = std::find_if(message.signals.begin(), message.signals.end(), [&term](const Signal& signal){return signal.name == term.signal;});
+        if (it == message.signals.end()) return 2;
+
+        Instruction instruction;
+        if (compile_term(*it, term, &instruction)){
+            std::cerr << "Error (Wreath::DBC::Trigger): Signal '" << it->name << "' in message '" << message.name << "' does not fit in a classic CAN payload\n";
+            return 1;
+        }
+        out_program->code.push_back(instruction);
+    }
+    //Depth never exceeds the instruction count, so the stack is sized once here
+    out_program->stack.assign(out_program->code.size(), 0);
+    out_program->length = message.length;
+    return 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int Trigger_Set::init(const Database& database){
+    if (database.load_all()) return 1;
+    this->database = &database;
+    programs.clear();
+    expressions.clear();
+    return 0;
+}
+int Trigger_Set::add_trigger(const std::string& expression, std::size_t* out_trigger){
+    if (!database) return 1;
+    std::vector<Term> terms;
+    std::uint64_t hold_ns;
+    Cursor cursor{expression, 0};
+    if (parse_expression(&cursor, &terms) || parse_hold(&cursor, &hold_ns)) return 1;
+    skip_space(&cursor);
+    if (cursor.pos != expression.size()) return parse_error(cursor, "Unexpected trailing input");
+
+    //Compile everything before touching 'programs' so a failure leaves the set unchanged
+    std::vector<std::pair<canid_t, Program>> compiled;
+    for (const Message& message : database->objects){
+        Program program{};
+        int res = compile_program(message, terms, &program);
+        if (res == 1) return 1;
+        if (res == 2) continue;
+        program.trigger = expressions.size();
+        program.hold_ns = hold_ns;
+        compiled.emplace_back((canid_t)message.id, std::move(program));
+    }
+    if (compiled.empty()){
+        std::cerr << "Error (Wreath::DBC::Trigger): No single message has every signal referenced by '" << expression << "'\n";
+        return 1;
+    }
+
+    for (std::pair<canid_t, Program>& entry : compiled) programs[entry.first].push_back(std::move(entry.second));
+    if (out_trigger) *out_trigger = expressions.size();
+    expressions.push_back(expression);
+    return 0;
+}
+void Trigger_Set::reset(){
+    for (std::pair<const canid_t, std::vector<Program>>& entry : programs){
+        for (Program& program : entry.second) program.holding = false;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+static bool run_program(Program* program, std::uint64_t payload){
+    std::uint8_t* stack = program->stack.data();
+    std::size_t top = 0;
+    auto push = [&](bool value){stack[top++] = value;};
+    auto pop = [&](){return (bool)stack[--top];};
+
+    std::uint64_t swapped = std::byteswap(payload);
+    for (const Instruction& instruction : program->code){
+        switch (instruction.op){
+            case Opcode::Constant:
+                push(instruction.value);
+                break;
+            case Opcode::Compare_Raw:{
+                std::uint64_t bits = ((instruction.swap ? swapped : payload) >> instruction.shift) & instruction.mask;
+                std::int64_t raw = (std::int64_t)bits;
+                if (instruction.is_signed) raw = (std::int64_t)(bits << (64 - instruction.bit_length)) >> (64 - instruction.bit_length);
+                push(compare_values(instruction.compare, raw, instruction.raw_threshold));
+                break;
+            }
+            case Opcode::Compare_Physical:{
+                std::uint64_t bits = ((instruction.swap ? swapped : payload) >> instruction.shift) & instruction.mask;
+                push(compare_values(instruction.compare, Package::raw_to_physical(*instruction.signal, bits), instruction.threshold));
+                break;
+            }
+            case Opcode::Not:
+                push(!pop());
+                break;
+            case Opcode::And:{
+                bool rhs = pop();
+                bool lhs = pop();
+                push(lhs && rhs);
+                break;
+            }
+            case Opcode::Or:{
+                bool rhs = pop();
+                bool lhs = pop();
+                push(lhs || rhs);
+                break;
+            }
+        }
+    }
+    return pop();
+}
+
+int Trigger_Set::evaluate_frame(const can_frame* frame, std::uint64_t timestamp_ns, std::vector<std::size_t>* out_fired){
+    out_fired->clear();
+    //Remote requests share the data message's ID but carry no signals, so they must not touch hold state
+    if (frame->can_id & CAN_RTR_FLAG) return 2;
+    std::unordered_map<canid_t, std::vector<Program>>::iterator it = programs.find(frame->can_id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+    if (it == programs.end()) return 1;
+
+    std::uint64_t payload = Package::load_payload(frame);
+    for (Program& program : it->second){
+        //A short frame would read its missing signals as zero, so it never counts as a match
+        if (frame->len < program.length || !run_program(&program, payload)){
+            program.holding = false;
+            continue;
+        }
+        if (!program.holding){
+            program.holding = true;
+            program.since_ns = timestamp_ns;
+        }
+        if (timestamp_ns - program.since_ns >= program.hold_ns) out_fired->push_back(program.trigger);
+    }
+    return out_fired->empty() ? 2 : 0;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}
+}
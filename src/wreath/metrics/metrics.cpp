@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <cmath>
+#include <ctime>
+#include <bit>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "wreath/metrics/metrics.hpp"
+
+namespace Wreath{
+namespace Metrics{
+
+//---------------------------------------------------------------------------------------------------------
+
+std::atomic<bool> enabled{false};
+
+static std::mutex registry_mutex;
+static std::vector<std::shared_ptr<Thread_Shard>> registry;
+static std::unordered_map<int, std::unique_ptr<Socket_State>> sockets;
+
+//SO_RXQ_OVFL is a cumulative per-socket counter, so the last value seen is shared by every thread reading the socket
+static Socket_State& socket_state(int socket){
+    thread_local std::unordered_map<int, Socket_State*> cache;
+    std::unordered_map<int, Socket_State*>::iterator it = cache.find(socket);
+    if (it != cache.end()) return *it->second;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::unique_ptr<Socket_State>& state = sockets[socket];
+    if (!state) state = std::make_unique<Socket_State>();
+    cache[socket] = state.get();
+    return *state;
+}
+//Counters from different threads can arrive out of order; only a counter ahead of the last one adds drops
+static std::uint32_t advance_drop_counter(Socket_State& state, std::uint32_t drop_counter){
+    std::uint32_t last = state.last_drop_counter.load(std::memory_order_relaxed);
+    while ((std::int32_t)(drop_counter - last) > 0){
+        if (state.last_drop_counter.compare_exchange_weak(last, drop_counter, std::memory_order_relaxed)) return drop_counter - last;
+    }
+    return 0;
+}
+
+static Thread_Shard& local_shard(){
+    thread_local Thread_Shard* shard = nullptr;
+    if (!shard){
+        std::shared_ptr<Thread_Shard> created = std::make_shared<Thread_Shard>();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(created);
+        shard = created.get();
+    }
+    return *shard;
+}
+
+void set_enabled(bool state){
+    enabled.store(state, std::memory_order_relaxed);
+}
+std::uint64_t now_ns(){
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (std::uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+std::size_t Histogram::bucket_of(std::uint64_t value){
+    if (value < (std::uint64_t{1} << sub_bucket_bits)) return value;
+    std::size_t msb = 63 - std::countl_zero(value);
+    std::size_t shift = msb - sub_bucket_bits;
+    return ((msb - sub_bucket_bits + 1) << sub_bucket_bits) + ((value >> shift) - (std::uint64_t{1} << sub_bucket_bits));
+}
+std::uint64_t Histogram::bucket_upper(std::size_t bucket){
+    std::size_t row = bucket >> sub_bucket_bits;
+    std::uint64_t sub = bucket & ((std::size_t{1} << sub_bucket_bits) - 1);
+    if (!row) return sub;
+    std::size_t shift = row - 1;
+    std::uint64_t lower = ((std::uint64_t{1} << sub_bucket_bits) + sub) << shift;
+    return lower + ((std::uint64_t{1} << shift) - 1);
+}
+void Histogram::record(std::uint64_t value){
+    counts[bucket_of(value)]++;
+    count++;
+    sum += value;
+    max = std::max(max, value);
+}
+void Histogram::merge(const Histogram& other){
+    for (std::size_t a = 0; a < bucket_count; a++) counts[a] += other.counts[a];
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+std::uint64_t Histogram::percentile(double fraction) const{
+    if (!count) return 0;
+    std::uint64_t target = std::max<std::uint64_t>(1, (std::uint64_t)std::ceil(fraction * count));
+    std::uint64_t seen = 0;
+    for (std::size_t a = 0; a < bucket_count; a++){
+        seen += counts[a];
+        if (seen >= target) return std::min(bucket_upper(a), max);
+    }
+    return max;
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int watch_socket(int socket, std::uint32_t bitrate){
+    int on = 1;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        std::unique_ptr<Socket_State>& state = sockets[socket];
+        if (!state) state = std::make_unique<Socket_State>();
+        state->bitrate = bitrate;
+        state->last_drop_counter.store(0, std::memory_order_relaxed);
+    }
+    return setsockopt(socket, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+}
+
+//Nominal frame length plus worst-case stuff bits, so the resulting bus load is an upper bound
+std::size_t frame_bits(const can_frame& frame){
+    std::size_t payload = (frame.can_id & CAN_RTR_FLAG) ? 0 : std::min<std::size_t>(frame.len, CAN_MAX_DLEN) * 8;
+    std::size_t stuffable = ((frame.can_id & CAN_EFF_FLAG) ? 54 : 34) + payload;
+    return stuffable + 13 + (stuffable - 1) / 4;
+}
+
+static void record_bus_bits(Bus_Stats& bus, const can_frame& frame, std::uint64_t timestamp_ns){
+    bus.bits += frame_bits(frame);
+    if (!bus.first_ns) bus.first_ns = timestamp_ns;
+    bus.last_ns = timestamp_ns;
+}
+
+void record_rx(int socket, const can_frame& frame, std::uint64_t timestamp_ns, std::uint32_t drop_counter, bool has_drop_counter){
+    std::uint32_t dropped = has_drop_counter ? advance_drop_counter(socket_state(socket), drop_counter) : 0;
+    Thread_Shard& shard = local_shard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    Id_Stats& id = shard.ids[id_key(socket, frame.can_id & (CAN_EFF_FLAG | CAN_EFF_MASK))];
+    if (frame.can_id & CAN_RTR_FLAG) id.remote_frames++;
+    else{
+        if (id.frames){
+            double period = (double)(timestamp_ns - id.last_ns);
+            id.periods++;
+            id.period_sum_ns += period;
+            id.period_sq_sum_ns += period * period;
+        } else id.first_ns = timestamp_ns;
+        id.frames++;
+        id.bytes += frame.len;
+        id.last_ns = timestamp_ns;
+    }
+
+    Bus_Stats& bus = shard.buses[socket];
+    bus.rx_frames++;
+    record_bus_bits(bus, frame, timestamp_ns);
+    bus.dropped += dropped;
+}
+void record_tx(int socket, const can_frame& frame, std::uint64_t timestamp_ns){
+    Thread_Shard& shard = local_shard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Bus_Stats& bus = shard.buses[socket];
+    bus.tx_frames++;
+    record_bus_bits(bus, frame, timestamp_ns);
+}
+void record_rx_error(int socket){
+    Thread_Shard& shard = local_shard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.buses[socket].rx_errors++;
+}
+void record_tx_error(int socket){
+    Thread_Shard& shard = local_shard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.buses[socket].tx_errors++;
+}
+void record_decode(std::uint64_t latency_ns){
+    Thread_Shard& shard = local_shard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.decode_latency.record(latency_ns);
+}
+void record_encode(std::uint64_t latency_ns){
+    Thread_Shard& shard = local_shard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.encode_latency.record(latency_ns);
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+int snapshot(Snapshot* out_snapshot, const DBC::Database* database){
+    std::unordered_map<std::uint64_t, Id_Stats> ids;
+    std::unordered_map<int, Bus_Stats> buses;
+    std::unordered_map<int, std::uint32_t> socket_bitrates;
+    *out_snapshot = {};
+
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    for (const std::pair<const int, std::unique_ptr<Socket_State>>& entry : sockets) socket_bitrates[entry.first] = entry.second->bitrate;
+    for (const std::shared_ptr<Thread_Shard>& shard : registry){
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (const std::pair<const std::uint64_t, Id_Stats>& entry : shard->ids){
+            Id_Stats& merged = ids[entry.first];
+            if (entry.second.frames) merged.first_ns = merged.frames ? std::min(merged.first_ns, entry.second.first_ns) : entry.second.first_ns;
+            merged.last_ns = std::max(merged.last_ns, entry.second.last_ns);
+            merged.frames += entry.second.frames;
+            merged.remote_frames += entry.second.remote_frames;
+            merged.bytes += entry.second.bytes;
+            merged.periods += entry.second.periods;
+            merged.period_sum_ns += entry.second.period_sum_ns;
+            merged.period_sq_sum_ns += entry.second.period_sq_sum_ns;
+        }
+        for (const std::pair<const int, Bus_Stats>& entry : shard->buses){
+            Bus_Stats& merged = buses[entry.first];
+            merged.first_ns = merged.first_ns && entry.second.first_ns ? std::min(merged.first_ns, entry.second.first_ns) : std::max(merged.first_ns, entry.second.first_ns);
+            merged.last_ns = std::max(merged.last_ns, entry.second.last_ns);
+            merged.rx_frames += entry.second.rx_frames;
+            merged.tx_frames += entry.second.tx_frames;
+            merged.bits += entry.second.bits;
+            merged.rx_errors += entry.second.rx_errors;
+            merged.tx_errors += entry.second.tx_errors;
+            merged.dropped += entry.second.dropped;
+        }
+        out_snapshot->decode_latency.merge(shard->decode_latency);
+        out_snapshot->encode_latency.merge(shard->encode_latency);
+    }
+
+    for (const std::pair<const std::uint64_t, Id_Stats>& entry : ids){
+        const Id_Stats& stats = entry.second;
+        Id_Snapshot id{(int)(entry.first >> 32), (canid_t)entry.first, stats.frames, stats.remote_frames, stats.bytes, 0.0, 0.0, 0.0, 0.0};
+        if (stats.periods){
+            double mean = stats.period_sum_ns / stats.periods;
+            double variance = std::max(0.0, stats.period_sq_sum_ns / stats.periods - mean * mean);
+            id.period_ms = mean / 1e6;
+            id.jitter_ms = std::sqrt(variance) / 1e6;
+            if (stats.last_ns > stats.first_ns) id.rate_hz = (stats.frames - 1) * 1e9 / (stats.last_ns - stats.first_ns);
+        }
+        DBC::Message message;
+        if (database && !database->get_message_bid(id.id, &message)) id.expected_period_ms = message.cycle_time;
+        out_snapshot->ids.push_back(id);
+    }
+    std::sort(out_snapshot->ids.begin(), out_snapshot->ids.end(), [](const Id_Snapshot& lhs, const Id_Snapshot& rhs){return lhs.socket != rhs.socket ? lhs.socket < rhs.socket : lhs.id < rhs.id;});
+
+    for (const std::pair<const int, Bus_Stats>& entry : buses){
+        const Bus_Stats& stats = entry.second;
+        std::unordered_map<int, std::uint32_t>::const_iterator it = socket_bitrates.find(entry.first);
+        Bus_Snapshot bus{entry.first, stats.rx_frames, stats.tx_frames, stats.rx_errors, stats.tx_errors, stats.dropped, it == socket_bitrates.end() ? 0 : it->second, 0.0};
+        if (bus.bitrate && stats.last_ns > stats.first_ns) bus.load = stats.bits * 1e9 / ((double)bus.bitrate * (stats.last_ns - stats.first_ns));
+        out_snapshot->buses.push_back(bus);
+    }
+    std::sort(out_snapshot->buses.begin(), out_snapshot->buses.end(), [](const Bus_Snapshot& lhs, const Bus_Snapshot& rhs){return lhs.socket < rhs.socket;});
+    return 0;
+}
+
+static void dump_histogram(std::ostringstream& out, const char* name, const Histogram& histogram){
+    out << "# TYPE " << name << " summary\n";
+    for (double quantile : {0.5, 0.9, 0.99, 0.999}){
+        out << name << "{quantile=\"" << quantile << "\"} " << histogram.percentile(quantile) / 1e9 << "\n";
+    }
+    out << name << "_sum " << histogram.sum / 1e9 << "\n";
+    out << name << "_count " << histogram.count << "\n";
+}
+
+int dump(int fd, const DBC::Database* database){
+    Snapshot metrics;
+    snapshot(&metrics, database);
+
+    std::ostringstream out;
+    out << "# TYPE wreath_can_frames_total counter\n";
+    for (const Id_Snapshot& id : metrics.ids) out << "wreath_can_frames_total{socket=\"" << id.socket << "\",id=\"0x" << std::hex << id.id << std::dec << "\"} " << id.frames << "\n";
+    out << "# TYPE wreath_can_remote_frames_total counter\n";
+    for (const Id_Snapshot& id : metrics.ids) out << "wreath_can_remote_frames_total{socket=\"" << id.socket << "\",id=\"0x" << std::hex << id.id << std::dec << "\"} " << id.remote_frames << "\n";
+    out << "# TYPE wreath_can_period_seconds gauge\n";
+    for (const Id_Snapshot& id : metrics.ids) out << "wreath_can_period_seconds{socket=\"" << id.socket << "\",id=\"0x" << std::hex << id.id << std::dec << "\"} " << id.period_ms / 1e3 << "\n";
+    out << "# TYPE wreath_can_period_jitter_seconds gauge\n";
+    for (const Id_Snapshot& id : metrics.ids) out << "wreath_can_period_jitter_seconds{socket=\"" << id.socket << "\",id=\"0x" << std::hex << id.id << std::dec << "\"} " << id.jitter_ms / 1e3 << "\n";
+    out << "# TYPE wreath_can_expected_period_seconds gauge\n";
+    for (const Id_Snapshot& id : metrics.ids){
+        if (id.expected_period_ms > 0.0) out << "wreath_can_expected_period_seconds{socket=\"" << id.socket << "\",id=\"0x" << std::hex << id.id << std::dec << "\"} " << id.expected_period_ms / 1e3 << "\n";
+    }
+
+    out << "# TYPE wreath_can_bus_frames_total counter\n";
+    for (const Bus_Snapshot& bus : metrics.buses){
+        out << "wreath_can_bus_frames_total{socket=\"" << bus.socket << "\",direction=\"rx\"} " << bus.rx_frames << "\n";
+        out << "wreath_can_bus_frames_total{socket=\"" << bus.socket << "\",direction=\"tx\"} " << bus.tx_frames << "\n";
+    }
+    out << "# TYPE wreath_can_bus_errors_total counter\n";
+    for (const Bus_Snapshot& bus : metrics.buses){
+        out << "wreath_can_bus_errors_total{socket=\"" << bus.socket << "\",direction=\"rx\"} " << bus.rx_errors << "\n";
+        out << "wreath_can_bus_errors_total{socket=\"" << bus.socket << "\",direction=\"tx\"} " << bus.tx_errors << "\n";
+    }
+    out << "# TYPE wreath_can_bus_dropped_total counter\n";
+    for (const Bus_Snapshot& bus : metrics.buses) out << "wreath_can_bus_dropped_total{socket=\"" << bus.socket << "\"} " << bus.dropped << "\n";
+    out << "# TYPE wreath_can_bus_load_ratio gauge\n";
+    for (const Bus_Snapshot& bus : metrics.buses){
+        if (bus.bitrate) out << "wreath_can_bus_load_ratio{socket=\"" << bus.socket << "\"} " << bus.load << "\n";
+    }
+
+    dump_histogram(out, "wreath_dbc_decode_latency_seconds", metrics.decode_latency);
+    dump_histogram(out, "wreath_dbc_encode_latency_seconds", metrics.encode_latency);
+
+    std::string text = out.str();
+    for (std::size_t done = 0; done < text.size();){
+        ssize_t res = write(fd, text.data() + done, text.size() - done);
+        if (res <= 0) return 1;
+        done += res;
+    }
+    return 0;
+}
+void reset(){
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    for (const std::shared_ptr<Thread_Shard>& shard : registry){
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->ids.clear();
+        shard->buses.clear();
+        shard->decode_latency = {};
+        shard->encode_latency = {};
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------
+
+}
+}